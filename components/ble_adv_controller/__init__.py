@@ -1,6 +1,7 @@
 import esphome.codegen as cg
 import esphome.config_validation as cv
-from esphome.core import ID
+import esphome.final_validate as fv
+from esphome.core import CORE, ID
 from esphome.const import (
     CONF_DURATION,
     CONF_ID,
@@ -19,6 +20,14 @@ from .const import (
     CONF_BLE_ADV_MAX_DURATION,
     CONF_BLE_ADV_SEQ_DURATION,
     CONF_BLE_ADV_SHOW_CONFIG,
+    CONF_BLE_ADV_SCHEDULER,
+    CONF_BLE_ADV_PRIORITY,
+    CONF_BLE_ADV_WEIGHT,
+    CONF_BLE_ADV_ALL_ENCODERS,
+    CONF_BLE_ADV_SIGN_ENGINE,
+    CONF_BLE_ADV_ADAPTIVE_DURATION,
+    CONF_BLE_ADV_DURATION_FLOOR,
+    CONF_BLE_ADV_ADAPTIVE_BACKLOG,
 )
 
 AUTO_LOAD = ["esp32_ble", "select", "number"]
@@ -29,15 +38,33 @@ bleadvcontroller_ns = cg.esphome_ns.namespace('bleadvcontroller')
 BleAdvController = bleadvcontroller_ns.class_('BleAdvController', cg.Component, cg.EntityBase)
 BleAdvEncoder = bleadvcontroller_ns.class_('BleAdvEncoder')
 BleAdvMultiEncoder = bleadvcontroller_ns.class_('BleAdvMultiEncoder', BleAdvEncoder)
+BleAdvStaticEncoder = bleadvcontroller_ns.class_('BleAdvStaticEncoder', BleAdvEncoder)
 BleAdvHandler = bleadvcontroller_ns.class_('BleAdvHandler', cg.Component)
 BleAdvEntity = bleadvcontroller_ns.class_('BleAdvEntity', cg.Component)
 
+SchedulerPolicy = bleadvcontroller_ns.enum("SchedulerPolicy")
+BLE_ADV_SCHEDULERS = {
+    "round_robin": SchedulerPolicy.ROUND_ROBIN,
+    "weighted_fair": SchedulerPolicy.WEIGHTED_FAIR,
+    "priority": SchedulerPolicy.PRIORITY,
+}
+
 FanLampEncoderV1 = bleadvcontroller_ns.class_('FanLampEncoderV1')
 FanLampEncoderV2 = bleadvcontroller_ns.class_('FanLampEncoderV2')
 ZhijiaEncoderV0 = bleadvcontroller_ns.class_('ZhijiaEncoderV0')
 ZhijiaEncoderV1 = bleadvcontroller_ns.class_('ZhijiaEncoderV1')
 ZhijiaEncoderV2 = bleadvcontroller_ns.class_('ZhijiaEncoderV2')
 
+# AES backends of the FanLamp signature, the key schedule one being set by default
+SoftSignEngine = bleadvcontroller_ns.class_('SoftSignEngine')
+HwSignEngine = bleadvcontroller_ns.class_('HwSignEngine')
+BLE_ADV_SIGN_ENGINES = {
+    "software": SoftSignEngine,
+    "hardware": HwSignEngine,
+}
+
+# duration_floor: the minimum duration in ms a command of the variant is reliably received by the devices,
+# used by 'adaptive_duration' unless overridden in the controller config. To be lowered once measured for a variant.
 BLE_ADV_ENCODERS = {
     "fanlamp_pro" :{
         "variants": {
@@ -47,18 +74,21 @@ BLE_ADV_ENCODERS = {
                 "max_forced_id": 0xFFFFFF,
                 "ble_param": [ 0x19, 0x03 ],
                 "header": [0x77, 0xF8],
+                "duration_floor": 100,
             },
             "v2": {
                 "class": FanLampEncoderV2,
                 "args": [ [0x10, 0x80, 0x00], 0x0400, False ],
                 "ble_param": [ 0x19, 0x03 ],
                 "header": [0xF0, 0x08],
+                "duration_floor": 100,
             },
             "v3": {
                 "class": FanLampEncoderV2,
                 "args": [ [0x20, 0x80, 0x00], 0x0400, True ],
                 "ble_param": [ 0x19, 0x03 ],
                 "header": [0xF0, 0x08],
+                "duration_floor": 100,
             },
             "v1a": {
                 "legacy": True,
@@ -80,6 +110,7 @@ BLE_ADV_ENCODERS = {
                 "max_forced_id": 0xFFFFFF,
                 "ble_param": [ 0x19, 0x03 ],
                 "header": [0x77, 0xF8],
+                "duration_floor": 100,
             },
             # v2 is only used by LampSmart Pro - Soft Lighting
             "v2": {
@@ -87,12 +118,14 @@ BLE_ADV_ENCODERS = {
                 "args": [ [0x10, 0x80, 0x00], 0x0100, False ],
                 "ble_param": [ 0x19, 0x03 ],
                 "header": [0xF0, 0x08],
+                "duration_floor": 100,
             },
             "v3": {
                 "class": FanLampEncoderV2,
                 "args": [ [0x30, 0x80, 0x00], 0x0100, True ],
                 "ble_param": [ 0x19, 0x03 ],
                 "header": [0xF0, 0x08],
+                "duration_floor": 100,
             },
             "v1a": {
                 "legacy": True,
@@ -114,6 +147,7 @@ BLE_ADV_ENCODERS = {
                 "max_forced_id": 0xFFFF,
                 "ble_param": [ 0x1A, 0xFF ],
                 "header": [ 0xF9, 0x08, 0x49 ],
+                "duration_floor": 100,
             },
             "v1": {
                 "class": ZhijiaEncoderV1,
@@ -121,6 +155,7 @@ BLE_ADV_ENCODERS = {
                 "max_forced_id": 0xFFFFFF,
                 "ble_param": [ 0x1A, 0xFF ],
                 "header": [ 0xF9, 0x08, 0x49 ],
+                "duration_floor": 100,
             },
             "v2": {
                 "class": ZhijiaEncoderV2,
@@ -128,6 +163,7 @@ BLE_ADV_ENCODERS = {
                 "max_forced_id": 0xFFFFFF,
                 "ble_param": [ 0x1A, 0xFF ],
                 "header": [ 0x22, 0x9D ],
+                "duration_floor": 100,
             },
         },
         "default_variant": "v2",
@@ -141,12 +177,14 @@ BLE_ADV_ENCODERS = {
                 "max_forced_id": 0xFFFFFF,
                 "ble_param": [ 0x00, 0xFF ],
                 "header":[0x56, 0x55, 0x18, 0x87, 0x52], 
+                "duration_floor": 100,
             },
             "v3": {
                 "class": FanLampEncoderV2,
                 "args": [ [0x10, 0x00, 0x56], 0x0400, True ],
                 "ble_param": [ 0x02, 0x16 ],
                 "header": [0xF0, 0x08],
+                "duration_floor": 100,
             },
         },
         "default_variant": "v3",
@@ -163,6 +201,7 @@ BLE_ADV_ENCODERS = {
                 "max_forced_id": 0xFFFFFF,
                 "ble_param": [ 0x02, 0x16 ],
                 "header":  [0xF9, 0x08],
+                "duration_floor": 100,
                 # 02.01.02.1B.03.F9.08.49.13.F0.69.25.4E.31.51.BA.32.08.0A.24.CB.3B.7C.71.DC.8B.B8.97.08.D0.4C (31)
             },
             "v1a": {
@@ -171,6 +210,7 @@ BLE_ADV_ENCODERS = {
                 "max_forced_id": 0xFFFFFF,
                 "ble_param": [ 0x02, 0x03 ],
                 "header": [0x77, 0xF8],
+                "duration_floor": 100,
                 # 02.01.02.1B.03.77.F8.B6.5F.2B.5E.00.FC.31.51.50.CB.92.08.24.CB.BB.FC.14.C6.9E.B0.E9.EA.73.A4 (31)
             },
             "v2": {
@@ -178,6 +218,7 @@ BLE_ADV_ENCODERS = {
                 "args": [ [0x10, 0x80, 0x00], 0x0100, False ],
                 "ble_param": [ 0x19, 0x16 ],
                 "header": [0xF0, 0x08],
+                "duration_floor": 100,
                 # 02.01.02.1B.16.F0.08.10.80.0B.9B.DA.CF.BE.B3.DD.56.3B.E9.1C.FC.27.A9.3A.A5.38.2D.3F.D4.6A.50 (31)
             },
             "v3": {
@@ -185,6 +226,7 @@ BLE_ADV_ENCODERS = {
                 "args": [ [0x10, 0x80, 0x00], 0x0100, True ],
                 "ble_param": [ 0x19, 0x16 ],
                 "header": [0xF0, 0x08],
+                "duration_floor": 100,
                 # 02.01.02.1B.16.F0.08.10.80.33.BC.2E.B0.49.EA.58.76.C0.1D.99.5E.9C.D6.B8.0E.6E.14.2B.A5.30.A9 (31)
             },
         },
@@ -206,8 +248,14 @@ CONTROLLER_BASE_CONFIG = cv.ENTITY_BASE_SCHEMA.extend(
         cv.Optional(CONF_BLE_ADV_MAX_DURATION, default=3000): cv.All(cv.positive_int, cv.Range(min=300, max=10000)),
         cv.Optional(CONF_BLE_ADV_SEQ_DURATION, default=100): cv.All(cv.positive_int, cv.Range(min=0, max=150)),
         cv.Optional(CONF_REVERSED, default=False): cv.boolean,
-        cv.Optional(CONF_BLE_ADV_SHOW_CONFIG, default=True): cv.boolean,
+        cv.Optional(CONF_BLE_ADV_SHOW_CONFIG, default=False): cv.boolean,
         cv.Optional(CONF_INDEX, default=0): cv.All(cv.positive_int, cv.Range(min=0, max=255)),
+        cv.Optional(CONF_BLE_ADV_SCHEDULER): cv.enum(BLE_ADV_SCHEDULERS, lower=True),
+        cv.Optional(CONF_BLE_ADV_PRIORITY, default=0): cv.All(cv.positive_int, cv.Range(min=0, max=3)),
+        cv.Optional(CONF_BLE_ADV_WEIGHT, default=1): cv.All(cv.positive_int, cv.Range(min=1, max=10)),
+        cv.Optional(CONF_BLE_ADV_ADAPTIVE_DURATION, default=False): cv.boolean,
+        cv.Optional(CONF_BLE_ADV_DURATION_FLOOR): cv.All(cv.positive_int, cv.Range(min=50, max=500)),
+        cv.Optional(CONF_BLE_ADV_ADAPTIVE_BACKLOG, default=4): cv.All(cv.positive_int, cv.Range(min=1, max=16)),
     }
 )
 
@@ -244,11 +292,35 @@ CONFIG_SCHEMA = cv.All(
     cv.only_on([PLATFORM_ESP32]),
 )
 
+def validate_scheduler(config):
+    # The scheduler is shared by all controllers, it can be set by any of them but must be consistent
+    schedulers = { cont[CONF_BLE_ADV_SCHEDULER] for cont in fv.full_config.get()["ble_adv_controller"] if CONF_BLE_ADV_SCHEDULER in cont }
+    if len(schedulers) > 1:
+        raise cv.Invalid("Inconsistent '%s' in between controllers: %s" % (CONF_BLE_ADV_SCHEDULER, ", ".join(sorted(str(x) for x in schedulers))))
+    return config
+
+FINAL_VALIDATE_SCHEMA = validate_scheduler
+
 async def entity_base_code_gen(var, config):
     await cg.register_parented(var, config[CONF_BLE_ADV_CONTROLLER_ID])
     await cg.register_component(var, config)
     await setup_entity(var, config)
 
+def get_used_variants():
+    # The encoders needed by the controllers: the variant they use, or all the variants of their encoding 
+    # if the 'Encoding' select is shown. All encoders are needed if requested in the handler config (capture of any traffic)
+    if CORE.config.get("ble_adv_handler", {}).get(CONF_BLE_ADV_ALL_ENCODERS, False):
+        return None
+    conts = CORE.config.get("ble_adv_controller", [])
+    used = set()
+    for cont in conts:
+        encoding = cont[CONF_BLE_ADV_ENCODING]
+        if cont[CONF_BLE_ADV_SHOW_CONFIG]:
+            used.update((encoding, variant) for variant in BLE_ADV_ENCODERS[encoding]["variants"])
+        else:
+            used.add((encoding, cont[CONF_VARIANT]))
+    return used
+
 class BleAdvRegistry:
     handler = None
     @classmethod
@@ -258,13 +330,18 @@ class BleAdvRegistry:
             cls.handler = cg.new_Pvariable(hdl_id)
             cg.add(cls.handler.set_component_source("ble_adv_handler"))
             cg.add(cg.App.register_component(cls.handler))
+            used = get_used_variants()
+            sign_engine = CORE.config.get("ble_adv_handler", {}).get(CONF_BLE_ADV_SIGN_ENGINE, "schedule")
             for encoding, params in BLE_ADV_ENCODERS.items():
                 for variant, param_variant in params["variants"].items():
-                    if "class" in param_variant:
-                        enc_id = ID("enc_%s_%s" % (encoding, variant), type=param_variant["class"])
+                    if "class" in param_variant and (used is None or (encoding, variant) in used):
+                        # BLE parameters and header fixed at compile time
+                        enc_class = BleAdvStaticEncoder.template(param_variant["class"], *param_variant["ble_param"], *param_variant["header"])
+                        enc_id = ID("enc_%s_%s" % (encoding, variant), type=enc_class)
                         enc = cg.new_Pvariable(enc_id, encoding, variant, *param_variant["args"])
-                        cg.add(enc.set_ble_param(*param_variant["ble_param"]))
-                        cg.add(enc.set_header(param_variant["header"]))
+                        cg.add(enc.set_duration_floor(param_variant["duration_floor"]))
+                        if param_variant["class"] is FanLampEncoderV2 and sign_engine in BLE_ADV_SIGN_ENGINES:
+                            cg.add(enc.set_sign_engine(cg.RawExpression("new %s()" % BLE_ADV_SIGN_ENGINES[sign_engine])))
                         cg.add(cls.handler.add_encoder(enc))
         return cls.handler
 
@@ -275,15 +352,27 @@ async def to_code(config):
     await cg.register_component(var, config)
     await setup_entity(var, config)
     cg.add(var.set_handler(hdl))
+    # room in the advertiser queue for the biggest command: one packet per variant when using 'All', only selectable if shown
+    # twice, the next command being added while the packets of the one it replaces may still be on air
+    nb_variants = 1
+    if config[CONF_BLE_ADV_SHOW_CONFIG]:
+        nb_variants = len([v for v in BLE_ADV_ENCODERS[config[CONF_BLE_ADV_ENCODING]]["variants"].values() if "class" in v])
+    cg.add(hdl.reserve_queue(2 * nb_variants))
     cg.add(var.set_encoding_and_variant(config[CONF_BLE_ADV_ENCODING], config[CONF_VARIANT]))
     cg.add(var.set_min_tx_duration(config[CONF_DURATION], 100, 500, 10))
     cg.add(var.set_max_tx_duration(config[CONF_BLE_ADV_MAX_DURATION]))
     cg.add(var.set_seq_duration(config[CONF_BLE_ADV_SEQ_DURATION]))
+    # floor of the encoder used if not given (0)
+    cg.add(var.set_adaptive_duration(config[CONF_BLE_ADV_ADAPTIVE_DURATION], config.get(CONF_BLE_ADV_DURATION_FLOOR, 0), config[CONF_BLE_ADV_ADAPTIVE_BACKLOG]))
     cg.add(var.set_reversed(config[CONF_REVERSED]))
     if CONF_BLE_ADV_FORCED_ID in config and config[CONF_BLE_ADV_FORCED_ID] > 0:
         cg.add(var.set_forced_id(config[CONF_BLE_ADV_FORCED_ID]))
     else:
         cg.add(var.set_forced_id(config[CONF_ID].id))
     cg.add(var.set_show_config(config[CONF_BLE_ADV_SHOW_CONFIG]))
+    cg.add(var.set_priority(config[CONF_BLE_ADV_PRIORITY]))
+    cg.add(var.set_weight(config[CONF_BLE_ADV_WEIGHT]))
+    if CONF_BLE_ADV_SCHEDULER in config:
+        cg.add(hdl.set_scheduler(config[CONF_BLE_ADV_SCHEDULER]))
 
 
@@ -14,16 +14,22 @@ void BleAdvSelect::control(const std::string &value) {
   this->rtc_.save(&hash_value);
 }
 
+void BleAdvSelect::set_options(const std::vector< std::string > & options) {
+  this->traits.set_options(options);
+  this->option_hashes_.clear();
+  for (auto & opt: options) {
+    this->option_hashes_.push_back(fnv1_hash(opt));
+  }
+}
+
 void BleAdvSelect::sub_init() { 
   App.register_select(this);
   this->rtc_ = global_preferences->make_preference< uint32_t >(this->get_object_id_hash());
   uint32_t restored;
   if (this->rtc_.load(&restored)) {
-    for (auto & opt: this->traits.get_options()) {
-      if(fnv1_hash(opt) == restored) {
-        this->state = opt;
-        return;
-      }
+    auto it = std::find(this->option_hashes_.begin(), this->option_hashes_.end(), restored);
+    if (it != this->option_hashes_.end()) {
+      this->state = this->traits.get_options()[it - this->option_hashes_.begin()];
     }
   }
 }
@@ -43,14 +49,21 @@ void BleAdvNumber::sub_init() {
 }
 
 void BleAdvController::set_encoding_and_variant(const std::string & encoding, const std::string & variant) {
-  this->select_encoding_.traits.set_options(this->handler_->get_ids(encoding));
+  this->encoder_handles_ = this->handler_->get_handles(this->handler_->get_encoding_handle(encoding));
+  std::vector< std::string > options;
+  for (auto handle: this->encoder_handles_) {
+    options.push_back(this->handler_->get_encoder(handle)->get_id());
+  }
+  this->select_encoding_.set_options(options);
   this->cur_encoder_ = this->handler_->get_encoder(encoding, variant);
   this->select_encoding_.state = this->cur_encoder_->get_id();
   this->select_encoding_.add_on_state_callback(std::bind(&BleAdvController::refresh_encoder, this, std::placeholders::_1, std::placeholders::_2));
 }
 
 void BleAdvController::refresh_encoder(std::string id, size_t index) {
-  this->cur_encoder_ = this->handler_->get_encoder(id);
+  if (index < this->encoder_handles_.size()) {
+    this->cur_encoder_ = this->handler_->get_encoder(this->encoder_handles_[index]);
+  }
 }
 
 void BleAdvController::set_min_tx_duration(int tx_duration, int min, int max, int step) {
@@ -61,6 +74,7 @@ void BleAdvController::set_min_tx_duration(int tx_duration, int min, int max, in
 }
 
 void BleAdvController::setup() {
+  this->flow_ = this->handler_->register_flow(this->weight_);
 #ifdef USE_API
   register_service(&BleAdvController::on_pair, "pair_" + this->get_object_id());
   register_service(&BleAdvController::on_unpair, "unpair_" + this->get_object_id());
@@ -80,7 +94,9 @@ void BleAdvController::dump_config() {
   ESP_LOGCONFIG(TAG, "  Transmission Min Duration: %ld ms", this->get_min_tx_duration());
   ESP_LOGCONFIG(TAG, "  Transmission Max Duration: %ld ms", this->max_tx_duration_);
   ESP_LOGCONFIG(TAG, "  Transmission Sequencing Duration: %ld ms", this->seq_duration_);
+  ESP_LOGCONFIG(TAG, "  Adaptive Duration: %s, Floor: %ld ms, Backlog: %d", this->adaptive_duration_ ? "YES" : "NO", this->get_duration_floor(), (int)this->adaptive_backlog_);
   ESP_LOGCONFIG(TAG, "  Configuration visible: %s", this->show_config_ ? "YES" : "NO");
+  ESP_LOGCONFIG(TAG, "  Scheduling Priority: %d, Weight: %d", this->priority_, this->weight_);
 }
 
 #ifdef USE_API
@@ -114,6 +130,7 @@ void BleAdvController::on_raw_inject(std::string raw) {
 bool BleAdvController::enqueue(Command &cmd) {
   if (!this->cur_encoder_->is_supported(cmd)) {
     ESP_LOGW(TAG, "Unsupported command received: %d. Aborted.", cmd.main_cmd_);
+    this->nb_dropped_++;
     return false;
   }
 
@@ -122,12 +139,15 @@ bool BleAdvController::enqueue(Command &cmd) {
     this->params_.tx_count_ = 0;
   }
 
-  // Remove any previous command of the same type in the queue, if not used for several purposes
-  if (cmd.main_cmd_ != CommandType::CUSTOM) {
-    uint8_t nb_rm = std::count_if(this->commands_.begin(), this->commands_.end(), [&](QueueItem& q){ return q.cmd_type_ == cmd.cmd_; });
+  // Remove the pending commands superseded by this one: the new one is enqueued last and gives the final state
+  uint8_t key = get_coalesce_key(cmd.main_cmd_);
+  if (key != CommandType::NOCMD) {
+    auto superseded = [&](QueueItem& q){ return get_coalesce_key(q.cmd_type_) == key; };
+    uint8_t nb_rm = std::count_if(this->commands_.begin(), this->commands_.end(), superseded);
     if (nb_rm) {
       ESP_LOGD(TAG, "Removing %d previous pending commands", nb_rm);
-      this->commands_.remove_if( [&](QueueItem& q){ return q.cmd_type_ == cmd.cmd_; } );
+      this->commands_.remove_if(superseded);
+      this->nb_coalesced_ += nb_rm;
     }
   }
 
@@ -137,30 +157,113 @@ bool BleAdvController::enqueue(Command &cmd) {
   
   // setup seq duration for each packet
   bool use_seq_duration = (this->seq_duration_ > 0) && (this->seq_duration_ < this->get_min_tx_duration());
+  this->seq_len_ = 0;
   for (auto & param : this->commands_.back().params_) {
     param.duration_ = use_seq_duration ? this->seq_duration_: this->get_min_tx_duration();
+    this->seq_len_ += param.duration_;
   }
   
   return true;
 }
 
+// Duration of a command when others are waiting: the min duration, or in adaptive mode reduced linearly 
+// down to the floor when 'adaptive_backlog' more commands are waiting, restored when the queue drains.
+uint32_t BleAdvController::get_tx_duration() {
+  uint32_t duration = this->get_min_tx_duration();
+  uint32_t floor = this->get_duration_floor();
+  if (!this->adaptive_duration_ || this->commands_.size() < 2 || duration <= floor) {
+    return duration;
+  }
+  size_t backlog = std::min(this->commands_.size() - 1, this->adaptive_backlog_);
+  return duration - (duration - floor) * backlog / this->adaptive_backlog_;
+}
+
+uint32_t BleAdvController::get_duration_floor() {
+  return (this->duration_floor_ > 0) ? this->duration_floor_ : this->cur_encoder_->get_duration_floor();
+}
+
+// Airtime of a streamed command: its tx duration, or the full sequence of its packets if longer,
+// based on the sequence of the last command enqueued as the streamed ones use the same encoder.
+bool BleAdvController::is_stream_ready(uint32_t last_frame_time, size_t nb_cmds) {
+  uint32_t airtime = std::max(this->get_tx_duration(), this->seq_len_);
+  return this->commands_.empty() && (millis() - last_frame_time >= nb_cmds * airtime);
+}
+
+// Commands with the same key supersede each other when pending: a newer DIM replaces a pending DIM, 
+// an OFF replaces a pending ON. NOCMD for the ones never removed: pairing, custom commands.
+uint8_t BleAdvController::get_coalesce_key(CommandType cmd_type) {
+  switch(cmd_type) {
+    case CommandType::LIGHT_ON:
+    case CommandType::LIGHT_OFF:
+      return CommandType::LIGHT_ON;
+    case CommandType::LIGHT_SEC_ON:
+    case CommandType::LIGHT_SEC_OFF:
+      return CommandType::LIGHT_SEC_ON;
+    case CommandType::FAN_ON:
+    case CommandType::FAN_OFF:
+      return CommandType::FAN_ON;
+    case CommandType::LIGHT_DIM:
+    case CommandType::LIGHT_CCT:
+    case CommandType::LIGHT_WCOLOR:
+    case CommandType::FAN_SPEED:
+    case CommandType::FAN_ONOFF_SPEED:
+    case CommandType::FAN_DIR:
+    case CommandType::FAN_OSC:
+      return cmd_type;
+    default:
+      return CommandType::NOCMD;
+  }
+}
+
+// Priority class of a command for the Advertiser: state changes (ON / OFF, ...) are ahead of continuous changes (DIM, ...)
+uint8_t BleAdvController::get_priority(CommandType cmd_type) {
+  bool continuous = (cmd_type == CommandType::LIGHT_DIM) || (cmd_type == CommandType::LIGHT_CCT) 
+                      || (cmd_type == CommandType::LIGHT_WCOLOR) || (cmd_type == CommandType::FAN_SPEED);
+  return 2 * this->priority_ + (continuous ? 0 : 1);
+}
+
 void BleAdvController::loop() {
   uint32_t now = millis();
   if(this->adv_start_time_ == 0) {
     // no on going command advertised by this controller, check if any to advertise
-    if(!this->commands_.empty()) {
+    // once the Advertiser has room for it, the packets of the previous one possibly still on air
+    if(!this->commands_.empty() && this->handler_->has_room(this->commands_.front().params_.size())) {
       QueueItem & item = this->commands_.front();
-      this->adv_id_ = this->handler_->add_to_advertiser(item.params_);
+      this->adv_id_ = this->handler_->add_to_advertiser(item.params_, this->flow_, this->get_priority(item.cmd_type_));
       this->adv_start_time_ = now;
+      this->adv_on_air_ = false;
       this->commands_.pop_front();
     }
   }
   else {
+    // The duration is counted from the first advertising of the command, not from its submission: when the Advertiser 
+    // is busy the next command is not submitted before, the backlog staying in this queue where commands are coalesced
+    if (!this->adv_on_air_) {
+      if (!this->handler_->is_advertised(this->adv_id_)) {
+        return;
+      }
+      this->adv_on_air_ = true;
+      this->adv_start_time_ = now;
+    }
     // command is being advertised by this controller, check if stop and clean-up needed
-    uint32_t duration = this->commands_.empty() ? this->max_tx_duration_ : this->number_duration_.state;
+    uint32_t duration = this->commands_.empty() ? this->max_tx_duration_ : this->get_tx_duration();
     if (now > this->adv_start_time_ + duration) {
-      this->adv_start_time_ = 0;
-      this->handler_->remove_from_advertiser(this->adv_id_);
+      if (this->commands_.empty()) {
+        this->adv_start_time_ = 0;
+        this->handler_->remove_from_advertiser(this->adv_id_);
+      } else {
+        // next command submitted together with the removal of the current one: the Advertiser switches at once
+        QueueItem & item = this->commands_.front();
+        this->adv_id_ = this->handler_->replace_in_advertiser(this->adv_id_, item.params_, this->flow_, this->get_priority(item.cmd_type_));
+        if (this->adv_id_ == 0) {
+          // no room yet: kept first in the queue, added as soon as the replaced one leaves the Advertiser
+          this->adv_start_time_ = 0;
+          return;
+        }
+        this->adv_start_time_ = now;
+        this->adv_on_air_ = false;
+        this->commands_.pop_front();
+      }
     }
   }
 }
@@ -44,9 +44,14 @@ protected:
   BleAdvSelect: basic implementation of 'Select' to handle configuration choice from HA directly
  */
 class BleAdvSelect: public BleAdvDynConfig < select::Select > {
+public:
+  // options and their hashes as saved, computed once
+  void set_options(const std::vector< std::string > & options);
+
 protected:
   void control(const std::string &value) override;
   void sub_init() override;
+  std::vector< uint32_t > option_hashes_;
 };
 
 /**
@@ -79,6 +84,11 @@ public:
   uint32_t get_min_tx_duration() { return (uint32_t)this->number_duration_.state; }
   void set_max_tx_duration(uint32_t tx_duration) { this->max_tx_duration_ = tx_duration; }
   void set_seq_duration(uint32_t seq_duration) { this->seq_duration_ = seq_duration; }
+  void set_adaptive_duration(bool adaptive, uint32_t floor, size_t backlog) { 
+    this->adaptive_duration_ = adaptive; this->duration_floor_ = floor; this->adaptive_backlog_ = backlog; 
+  }
+  uint32_t get_duration_floor();
+  uint32_t get_tx_duration();
   void set_forced_id(uint32_t forced_id) { this->params_.id_ = forced_id; }
   void set_forced_id(const std::string & str_id) { this->params_.id_ = fnv1_hash(str_id); }
   void set_index(uint8_t index) { this->params_.index_ = index; }
@@ -87,6 +97,16 @@ public:
   bool is_reversed() const { return this->reversed_; }
   bool is_supported(const Command &cmd) { return this->cur_encoder_->is_supported(cmd); }
   void set_show_config(bool show_config) { this->show_config_ = show_config; }
+  void set_priority(uint8_t priority) { this->priority_ = priority; }
+  void set_weight(uint8_t weight) { this->weight_ = weight; }
+  uint8_t get_priority(CommandType cmd_type);
+  static uint8_t get_coalesce_key(CommandType cmd_type);
+  // Metrics: pending commands, commands removed as superseded by a newer one, commands refused as not supported
+  size_t get_queue_depth() const { return this->commands_.size(); }
+  uint32_t get_nb_coalesced() const { return this->nb_coalesced_; }
+  uint32_t get_nb_dropped() const { return this->nb_dropped_; }
+  BleAdvHandler * get_handler() { return this->handler_; }
+  uint8_t get_flow() const { return this->flow_; }
   bool is_show_config() { return this->show_config_; }
 
   void set_handler(BleAdvHandler * handler) { this->handler_ = handler; }
@@ -101,18 +121,35 @@ public:
 #endif
 
   bool enqueue(Command &cmd);
+  // Streaming of intermediate states: ready when no command is pending and the airtime of the last frame is elapsed
+  bool is_stream_ready(uint32_t last_frame_time, size_t nb_cmds);
 
 protected:
 
   uint32_t max_tx_duration_ = 3000;
   uint32_t seq_duration_ = 150;
+  // total duration of the packets of the last command enqueued, advertised in sequence
+  uint32_t seq_len_ = 0;
+
+  // adaptive duration: the airtime per command is reduced down to the floor when commands are waiting,
+  // the floor of the encoder being used if not overridden (0)
+  bool adaptive_duration_{false};
+  uint32_t duration_floor_{0};
+  size_t adaptive_backlog_{4};
 
   ControllerParam_t params_;
 
   bool reversed_;
 
   bool show_config_{false};
+
+  // scheduling in the Advertiser
+  uint8_t priority_{0};
+  uint8_t weight_{1};
+  uint8_t flow_{0};
   BleAdvSelect select_encoding_;
+  // handles of the encoders selectable, in the order of the select options
+  std::vector< uint8_t > encoder_handles_;
   BleAdvEncoder * cur_encoder_{nullptr};
   BleAdvNumber number_duration_;
   BleAdvHandler * handler_{nullptr};
@@ -128,10 +165,14 @@ protected:
     QueueItem& operator=(QueueItem&&) = default;
   };
   std::list< QueueItem > commands_;
+  uint32_t nb_coalesced_{0};
+  uint32_t nb_dropped_{0};
 
   // Being advertised data properties
   uint32_t adv_start_time_ = 0;
   uint16_t adv_id_ = 0;
+  // advertised at least once, the start time being then the one of its first advertising
+  bool adv_on_air_ = false;
 };
 
 /**
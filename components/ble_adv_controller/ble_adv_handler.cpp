@@ -1,6 +1,7 @@
 #include "ble_adv_handler.h"
 #include "esphome/core/log.h"
 #include "esphome/core/hal.h"
+#include "esphome/core/application.h"
 
 #ifdef USE_ESP32_BLE_CLIENT
 #include "esphome/components/esp32_ble_tracker/esp32_ble_tracker.h"
@@ -11,6 +12,10 @@ namespace bleadvcontroller {
 
 static const char *TAG = "ble_adv_handler";
 
+void Commands::log_dropped(const Command & cmd) {
+  ESP_LOGW(TAG, "More than %zu translated commands, command 0x%02X dropped", MAX_COMMANDS, cmd.cmd_);
+}
+
 void BleAdvParam::from_raw(const uint8_t * buf, size_t len) {
   // Copy the raw data as is, limiting to the max size of the buffer
   this->len_ = std::min(MAX_PACKET_LEN, len);
@@ -69,58 +74,132 @@ void BleAdvParam::set_data_len(size_t len) {
   this->len_ = len + 2 + (this->has_ad_flag() ? 3 : 0);
 }
 
-bool BleAdvEncoder::is_supported(const Command &cmd) {
+void BleAdvEncoder::init_capabilities() {
   ControllerParam_t cont;
-  auto cmds = this->translate(cmd, cont);
-  return !cmds.empty();
+  this->capabilities_ = 0;
+  for (uint8_t type = 0; type < MAX_COMMAND_TYPE; ++type) {
+    Command cmd((CommandType)type);
+    if (!this->translate(cmd, cont).empty()) {
+      this->capabilities_ |= (uint64_t)1 << type;
+    }
+  }
 }
 
-bool BleAdvEncoder::decode(const BleAdvParam & param, Command &cmd, ControllerParam_t & cont) {
-  // Check global len and header to discard most of encoders
-  size_t len = param.get_data_len() - this->header_.size();
-  const uint8_t * cbuf = param.get_const_data_buf();
-  if (len != this->len_) return false;
-  if (!std::equal(this->header_.begin(), this->header_.end(), cbuf)) return false;
+/**
+  Whitening: 7 bits LFSR, only the 7 low bits of the seed are used.
+  Tables computed at compile time:
+    - the keystream byte and next state after the 8 steps of a byte, for any state
+    - the full keystream of the seeds used by the encoders, whitening being then a straight XOR
+ */
+struct WhiteningStep {
+  uint8_t out_[128]{0};
+  uint8_t next_[128]{0};
+  constexpr WhiteningStep() {
+    for (size_t s = 0; s < 128; ++s) {
+      uint8_t r = s;
+      uint8_t b = 0;
+      for (size_t j = 0; j < 8; ++j) {
+        r <<= 1;
+        if (r & 0x80) {
+          r ^= 0x11;
+          b |= 1 << j;
+        }
+        r &= 0x7F;
+      }
+      this->out_[s] = b;
+      this->next_[s] = r;
+    }
+  }
+};
+static constexpr WhiteningStep WHITENING_STEP{};
+
+struct WhiteningKey {
+  uint8_t seed_;
+  uint8_t key_[MAX_PACKET_LEN]{0};
+  constexpr WhiteningKey(uint8_t seed): seed_(seed) {
+    uint8_t r = seed & 0x7F;
+    for (size_t i = 0; i < MAX_PACKET_LEN; ++i) {
+      this->key_[i] = WHITENING_STEP.out_[r];
+      r = WHITENING_STEP.next_[r];
+    }
+  }
+};
+static constexpr WhiteningKey WHITENING_KEYS[] = { {0x37}, {0x7F}, {0x6F}, {0xD3} };
 
-  // copy the data to be decoded, not to alter it for other decoders
-  uint8_t buf[MAX_PACKET_LEN]{0};
-  std::copy(cbuf, cbuf + param.get_data_len(), buf);
-  return this->decode(buf + this->header_.size(), cmd, cont);
+void BleAdvEncoder::whiten(uint8_t *buf, size_t len, uint8_t seed) {
+  if (len <= MAX_PACKET_LEN) {
+    for (auto & key : WHITENING_KEYS) {
+      if (key.seed_ == seed) {
+        for (size_t i = 0; i < len; ++i) {
+          buf[i] ^= key.key_[i];
+        }
+        return;
+      }
+    }
+  }
+  uint8_t r = seed & 0x7F;
+  for (size_t i = 0; i < len; ++i) {
+    buf[i] ^= WHITENING_STEP.out_[r];
+    r = WHITENING_STEP.next_[r];
+  }
 }
 
-void BleAdvEncoder::encode(std::vector< BleAdvParam > & params, Command &cmd, ControllerParam_t & cont) {
-  auto cmds = (cmd.main_cmd_ == CommandType::CUSTOM) ? std::vector< Command >({cmd}) : this->translate(cmd, cont);
-  for (auto & acmd: cmds) {
-    cont.tx_count_++;
+/**
+  CRC16: tables computed at compile time, 256 entries per polynomial,
+  or 2 x 16 entries per polynomial (high / low nibble) if USE_BLE_ADV_CRC16_NIBBLE is defined, to save flash.
+ */
+struct Crc16Table {
+  uint16_t table_[256]{0};
+  constexpr Crc16Table(uint16_t poly, bool reflected) {
+    for (size_t i = 0; i < 256; ++i) {
+      uint16_t crc = reflected ? i : (i << 8);
+      for (size_t j = 0; j < 8; ++j) {
+        if (reflected) {
+          crc = (crc & 0x0001) ? ((crc >> 1) ^ poly) : (crc >> 1);
+        } else {
+          crc = (crc & 0x8000) ? ((crc << 1) ^ poly) : (crc << 1);
+        }
+      }
+      this->table_[i] = crc;
+    }
+  }
+};
 
-    params.emplace_back();
-    BleAdvParam & param = params.back();
-    param.init_with_ble_param(this->ad_flag_, this->adv_data_type_);
-    std::copy(this->header_.begin(), this->header_.end(), param.get_data_buf());
-    uint8_t * buf = param.get_data_buf() + this->header_.size();
+struct Crc16NibbleTable {
+  uint16_t low_[16]{0};
+  uint16_t high_[16]{0};
+  constexpr Crc16NibbleTable(uint16_t poly, bool reflected) {
+    Crc16Table full(poly, reflected);
+    for (size_t i = 0; i < 16; ++i) {
+      this->low_[i] = full.table_[i];
+      this->high_[i] = full.table_[i << 4];
+    }
+  }
+  uint16_t get(uint8_t index) const { return this->low_[index & 0x0F] ^ this->high_[index >> 4]; }
+};
 
-    ESP_LOGD(this->id_.c_str(), "UUID: '0x%lX', index: %d, tx: %d, cmd: '0x%02X', args: [%d,%d,%d,%d]", 
-        cont.id_, cont.index_, cont.tx_count_, acmd.cmd_, acmd.args_[0], acmd.args_[1], acmd.args_[2], acmd.args_[3]);
+#ifdef USE_BLE_ADV_CRC16_NIBBLE
+static constexpr Crc16NibbleTable CRC16_8408{0x8408, true};
+static constexpr Crc16NibbleTable CRC16_1021{0x1021, false};
+#define CRC16_GET(table, index) table.get(index)
+#else
+static constexpr Crc16Table CRC16_8408{0x8408, true};
+static constexpr Crc16Table CRC16_1021{0x1021, false};
+#define CRC16_GET(table, index) table.table_[index]
+#endif
 
-    this->encode(buf, acmd, cont);
-    param.set_data_len(this->len_ + this->header_.size());    
+uint16_t BleAdvEncoder::crc16_8408(const uint8_t* buf, size_t len, uint16_t crc) {
+  for (size_t i = 0; i < len; ++i) {
+    crc = (crc >> 8) ^ CRC16_GET(CRC16_8408, (uint8_t)(crc ^ buf[i]));
   }
+  return crc;
 }
 
-void BleAdvEncoder::whiten(uint8_t *buf, size_t len, uint8_t seed) {
-  uint8_t r = seed;
-  for (size_t i=0; i < len; i++) {
-    uint8_t b = 0;
-    for (size_t j=0; j < 8; j++) {
-      r <<= 1;
-      if (r & 0x80) {
-        r ^= 0x11;
-        b |= 1 << j;
-      }
-      r &= 0x7F;
-    }
-    buf[i] ^= b;
+uint16_t BleAdvEncoder::crc16_1021(const uint8_t* buf, size_t len, uint16_t crc) {
+  for (size_t i = 0; i < len; ++i) {
+    crc = (crc << 8) ^ CRC16_GET(CRC16_1021, (uint8_t)((crc >> 8) ^ buf[i]));
   }
+  return crc;
 }
 
 void BleAdvEncoder::reverse_all(uint8_t* buf, uint8_t len) {
@@ -142,32 +221,471 @@ void BleAdvMultiEncoder::encode(std::vector< BleAdvParam > & params, Command &cm
   cont.tx_count_ = count;
 }
 
-bool BleAdvMultiEncoder::is_supported(const Command &cmd) {
-  bool is_supported = false;
-  for(auto & encoder : this->encoders_) {
-    is_supported |= encoder->is_supported(cmd);
+void BleAdvTrace::add(Event event, uint16_t msg_id, const uint8_t * data, uint8_t len) {
+  Record & record = this->records_[this->count_ % this->records_.size()];
+  record.time_ = millis();
+  record.msg_id_ = msg_id;
+  record.event_ = event;
+  record.len_ = std::min(len, (uint8_t)MAX_PACKET_LEN);
+  if (data != nullptr) {
+    std::copy(data, data + record.len_, record.data_);
+  }
+  this->count_++;
+}
+
+void BleAdvTrace::dump(const char * tag) {
+  static const char * EVENT_NAMES[] = {"request", "drop", "on air", "off air", "decoded", "rejected"};
+  size_t nb = this->size();
+  ESP_LOGI(tag, "Trace - %zu events, %zu last ones:", this->count_, nb);
+  for (size_t i = this->count_ - nb; i < this->count_; ++i) {
+    Record & record = this->records_[i % this->records_.size()];
+    switch (record.event_) {
+      case ON_AIR:
+        ESP_LOGI(tag, "%lu ms - %s - msg %d, set %d, flow %d", record.time_, EVENT_NAMES[record.event_], 
+                  record.msg_id_, record.data_[0], record.data_[1]);
+        break;
+      case OFF_AIR:
+        ESP_LOGI(tag, "%lu ms - %s - msg %d, set %d", record.time_, EVENT_NAMES[record.event_], record.msg_id_, record.data_[0]);
+        break;
+      default:
+        ESP_LOGI(tag, "%lu ms - %s - msg %d: %s", record.time_, EVENT_NAMES[record.event_], record.msg_id_,
+                  esphome::format_hex_pretty(record.data_, record.len_).c_str());
+        break;
+    }
+    App.feed_wdt();
+  }
+}
+
+void BleAdvHistogram::add(uint32_t value) {
+  size_t bucket = 0;
+  while (value > BOUNDS[bucket]) {
+    bucket++;
   }
-  return is_supported;
+  this->counts_[bucket]++;
+  this->count_++;
+  this->max_ = std::max(this->max_, value);
 }
 
+uint32_t BleAdvHistogram::get_percentile(uint8_t percent) const {
+  uint32_t rank = (this->count_ * percent + 99) / 100;
+  uint32_t cumul = 0;
+  for (size_t bucket = 0; bucket < NB_BUCKETS; ++bucket) {
+    cumul += this->counts_[bucket];
+    if ((cumul >= rank) && (cumul > 0)) {
+      return std::min(BOUNDS[bucket], this->max_);
+    }
+  }
+  return this->max_;
+}
+
+void BleAdvHistogram::reset() {
+  std::fill(this->counts_, this->counts_ + NB_BUCKETS, 0);
+  this->count_ = 0;
+  this->max_ = 0;
+}
+
+void BleAdvQueue::init(size_t capacity) {
+  this->slots_.resize(std::min(capacity, MAX_CAPACITY));
+  // chain all slots in the free list
+  for (size_t i = 0; i < this->slots_.size(); ++i) {
+    this->slots_[i].next_ = (i + 1 < this->slots_.size()) ? i + 1 : NO_SLOT;
+  }
+  this->free_ = this->slots_.empty() ? NO_SLOT : 0;
+  this->cur_ = NO_SLOT;
+  this->size_ = 0;
+}
+
+uint16_t BleAdvQueue::push(std::vector< BleAdvParam > & params, uint8_t flow, uint8_t priority, uint32_t submit_time) {
+  if (params.empty() || (this->size_ + params.size() > this->capacity())) {
+    return 0;
+  }
+
+  // generation 0 is skipped so that 0 is never a valid msg id
+  if (++this->gen_ == 0) this->gen_ = 1;
+  uint16_t msg_id = ((uint16_t)this->gen_ << 8) | this->free_;
+  uint8_t prev_msg = NO_SLOT;
+  for (auto & param : params) {
+    // take the slot from the free list
+    uint8_t index = this->free_;
+    BleAdvProcess & slot = this->slots_[index];
+    this->free_ = slot.next_;
+
+    slot.param_ = std::move(param);
+    slot.id_ = msg_id;
+    slot.processed_once_ = false;
+    slot.to_be_removed_ = false;
+    slot.set_ = BleAdvProcess::NO_SET;
+    slot.flow_ = flow;
+    slot.priority_ = priority;
+    slot.waits_ = 0;
+    slot.submit_time_ = submit_time;
+    slot.next_msg_ = NO_SLOT;
+    if (prev_msg != NO_SLOT) {
+      this->slots_[prev_msg].next_msg_ = index;
+    }
+    prev_msg = index;
+
+    // insert at the back of the circular list, that is just before the current one
+    if (this->cur_ == NO_SLOT) {
+      slot.next_ = index;
+      slot.prev_ = index;
+      this->cur_ = index;
+    } else {
+      BleAdvProcess & cur = this->slots_[this->cur_];
+      slot.next_ = this->cur_;
+      slot.prev_ = cur.prev_;
+      this->slots_[cur.prev_].next_ = index;
+      cur.prev_ = index;
+    }
+    this->size_++;
+  }
+  return msg_id;
+}
+
+void BleAdvQueue::remove(uint16_t msg_id) {
+  uint8_t index = msg_id & 0xFF;
+  if ((msg_id == 0) || (index >= this->capacity()) || (this->slots_[index].id_ != msg_id)) {
+    return;
+  }
+  while (index != NO_SLOT) {
+    BleAdvProcess & slot = this->slots_[index];
+    uint8_t next_msg = slot.next_msg_;
+    slot.to_be_removed_ = true;
+    // the ones being advertised are removed when their advertising is stopped
+    if (slot.processed_once_ && !slot.on_air()) {
+      this->unlink(index);
+    }
+    index = next_msg;
+  }
+}
+
+void BleAdvQueue::take(uint8_t index) {
+  if (index == this->cur_) {
+    this->cur_ = this->slots_[index].next_;
+    return;
+  }
+  // detach the slot, and insert it again just before the first one: the others keep their order
+  BleAdvProcess & slot = this->slots_[index];
+  this->slots_[slot.prev_].next_ = slot.next_;
+  this->slots_[slot.next_].prev_ = slot.prev_;
+  BleAdvProcess & cur = this->slots_[this->cur_];
+  slot.next_ = this->cur_;
+  slot.prev_ = cur.prev_;
+  this->slots_[cur.prev_].next_ = index;
+  cur.prev_ = index;
+}
+
+void BleAdvQueue::unlink(uint8_t index) {
+  BleAdvProcess & slot = this->slots_[index];
+  if (slot.next_ == index) {
+    this->cur_ = NO_SLOT;
+  } else {
+    this->slots_[slot.prev_].next_ = slot.next_;
+    this->slots_[slot.next_].prev_ = slot.prev_;
+    if (this->cur_ == index) {
+      this->cur_ = slot.next_;
+    }
+  }
+  // invalidate the slot for any later remove and give it back to the free list
+  slot.id_ = 0;
+  slot.next_ = this->free_;
+  this->free_ = index;
+  this->size_--;
+}
+
+void BleAdvCaptureCache::init(size_t capacity) {
+  capacity = std::max(std::min(capacity, MAX_CAPACITY), (size_t)1);
+  size_t table_size = 1;
+  while (table_size < 2 * capacity) table_size <<= 1;
+  this->ring_.resize(capacity);
+  this->table_.assign(table_size, EMPTY);
+  this->mask_ = table_size - 1;
+  this->head_ = 0;
+  this->count_ = 0;
+}
+
+// FNV-1a
+uint32_t BleAdvCaptureCache::hash(const uint8_t * buf, size_t len) {
+  uint32_t hash = 2166136261UL;
+  for (size_t i = 0; i < len; ++i) {
+    hash = (hash ^ buf[i]) * 16777619UL;
+  }
+  return hash;
+}
+
+void BleAdvCaptureCache::unindex(uint16_t index) {
+  // find the entry in the table
+  size_t hole = this->ring_[index].hash_ & this->mask_;
+  while (this->table_[hole] != index) {
+    hole = (hole + 1) & this->mask_;
+  }
+  // backward shift the next entries of the probe sequence that can take the hole, no tombstone
+  size_t next = (hole + 1) & this->mask_;
+  while (this->table_[next] != EMPTY) {
+    size_t home = this->ring_[this->table_[next]].hash_ & this->mask_;
+    if (((next - home) & this->mask_) >= ((next - hole) & this->mask_)) {
+      this->table_[hole] = this->table_[next];
+      hole = next;
+    }
+    next = (next + 1) & this->mask_;
+  }
+  this->table_[hole] = EMPTY;
+}
+
+void BleAdvCaptureCache::pop_oldest() {
+  this->unindex(this->head_);
+  this->head_ = (this->head_ + 1) % this->ring_.size();
+  this->count_--;
+}
+
+void BleAdvCaptureCache::pop_newest() {
+  if (this->count_ > 0) {
+    this->unindex((this->head_ + this->count_ - 1) % this->ring_.size());
+    this->count_--;
+  }
+}
+
+bool BleAdvCaptureQueue::push(BleAdvParam & param, bool ignore_ble_param) {
+  size_t tail = this->tail_.load(std::memory_order_relaxed);
+  if (tail - this->head_.load(std::memory_order_acquire) >= this->items_.size()) {
+    return false;
+  }
+  Item & item = this->items_[tail % this->items_.size()];
+  item.param_ = std::move(param);
+  item.ignore_ble_param_ = ignore_ble_param;
+  this->tail_.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+BleAdvCaptureQueue::Item * BleAdvCaptureQueue::front() {
+  size_t head = this->head_.load(std::memory_order_relaxed);
+  if (head == this->tail_.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  return &(this->items_[head % this->items_.size()]);
+}
+
+bool BleAdvCaptureCache::add(BleAdvParam & param, uint32_t now, uint32_t retention_ms) {
+  // Clean-up expired packets
+  while ((this->count_ > 0) && ((int32_t)(this->ring_[this->head_].expiry_ - now) <= 0)) {
+    this->pop_oldest();
+  }
+
+  const uint8_t * buf = param.get_full_buf();
+  uint8_t len = param.get_full_len();
+  uint32_t hash = this->hash(buf, len);
+  size_t pos = hash & this->mask_;
+  while (this->table_[pos] != EMPTY) {
+    Entry & entry = this->ring_[this->table_[pos]];
+    if ((entry.hash_ == hash) && (entry.len_ == len) && std::equal(buf, buf + len, entry.buf_)) {
+      return false;
+    }
+    pos = (pos + 1) & this->mask_;
+  }
+
+  // Full: drop the oldest one, the probe sequence may have changed
+  if (this->count_ == this->ring_.size()) {
+    this->pop_oldest();
+    pos = hash & this->mask_;
+    while (this->table_[pos] != EMPTY) {
+      pos = (pos + 1) & this->mask_;
+    }
+  }
+
+  uint16_t index = (this->head_ + this->count_) % this->ring_.size();
+  Entry & entry = this->ring_[index];
+  entry.hash_ = hash;
+  entry.expiry_ = now + retention_ms;
+  entry.len_ = len;
+  std::copy(buf, buf + len, entry.buf_);
+  this->table_[pos] = index;
+  this->count_++;
+  return true;
+}
+
+void BleAdvEspGap::init(BleAdvHandler * handler, esp_ble_adv_params_t * params) {
+  this->handler_ = handler;
+  for (uint8_t set = 0; set < MAX_ADV_SETS; ++set) {
+    this->timer_args_[set] = { handler, set };
+    esp_timer_create_args_t args = {
+      .callback = [](void * arg) { 
+        TimerArg * targ = static_cast< TimerArg * >(arg);
+        targ->handler_->on_adv_timer(targ->set_);
+      },
+      .arg = &(this->timer_args_[set]),
+      .dispatch_method = ESP_TIMER_TASK,
+      .name = "ble_adv",
+      .skip_unhandled_events = true,
+    };
+    ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_create(&args, &(this->timers_[set])));
+  }
+}
+
+void BleAdvEspGap::start_timer(uint8_t set, uint32_t duration_ms) {
+  ESP_ERROR_CHECK_WITHOUT_ABORT(esp_timer_start_once(this->timers_[set], (uint64_t)duration_ms * 1000));
+}
+
+#ifdef CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+void BleAdvEspExtGap::init(BleAdvHandler * handler, esp_ble_adv_params_t * params) {
+  esp_ble_gap_ext_adv_params_t ext_params = {
+    .type = ESP_BLE_LEGACY_ADV_TYPE_NONCONN_IND,
+    .interval_min = params->adv_int_min,
+    .interval_max = params->adv_int_max,
+    .channel_map = params->channel_map,
+    .own_addr_type = params->own_addr_type,
+    .peer_addr_type = params->peer_addr_type,
+    .peer_addr = { 0x00 },
+    .filter_policy = params->adv_filter_policy,
+    .tx_power = EXT_ADV_TX_PWR_NO_PREFERENCE,
+    .primary_phy = ESP_BLE_GAP_PRI_PHY_1M,
+    .max_skip = 0,
+    .secondary_phy = ESP_BLE_GAP_PHY_1M,
+    .sid = 0,
+    .scan_req_notif = false,
+  };
+  BleAdvEspGap::init(handler, params);
+  // Use as many sets as the controller accepts, the sets being usable on the completion of their parameters
+  for (uint8_t set = 0; set < MAX_ADV_SETS; ++set) {
+    esp_err_t err = esp_ble_gap_ext_adv_set_params(set, &ext_params);
+    if (err != ESP_OK) {
+      ESP_LOGW(TAG, "Extended advertising set %d parameters not requested: %d", set, err);
+      break;
+    }
+    this->push_pending(OP_PARAMS, set);
+  }
+}
+
+void BleAdvEspExtGap::push_pending(PendingOp op, uint8_t set) {
+  if (this->pending_count_[op] < MAX_ADV_SETS) {
+    this->pending_[op][(this->pending_start_[op] + this->pending_count_[op]) % MAX_ADV_SETS] = set;
+    this->pending_count_[op]++;
+  }
+}
+
+bool BleAdvEspExtGap::pop_pending(PendingOp op, uint8_t & set) {
+  if (this->pending_count_[op] == 0) {
+    return false;
+  }
+  set = this->pending_[op][this->pending_start_[op]];
+  this->pending_start_[op] = (this->pending_start_[op] + 1) % MAX_ADV_SETS;
+  this->pending_count_[op]--;
+  return true;
+}
+
+esp_err_t BleAdvEspExtGap::config_adv_data_raw(uint8_t set, uint8_t * buf, size_t len) {
+  esp_err_t err = esp_ble_gap_config_ext_adv_data_raw(set, len, buf);
+  if (err == ESP_OK) this->push_pending(OP_DATA, set);
+  return err;
+}
+
+esp_err_t BleAdvEspExtGap::start_advertising(uint8_t set) {
+  esp_ble_gap_ext_adv_t ext_adv = { .instance = set, .duration = 0, .max_events = 0 };
+  esp_err_t err = esp_ble_gap_ext_adv_start(1, &ext_adv);
+  if (err == ESP_OK) this->push_pending(OP_START, set);
+  return err;
+}
+
+esp_err_t BleAdvEspExtGap::stop_advertising(uint8_t set) {
+  esp_err_t err = esp_ble_gap_ext_adv_stop(1, &set);
+  if (err == ESP_OK) this->push_pending(OP_STOP, set);
+  return err;
+}
+
+void BleAdvEspExtGap::gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) {
+  uint8_t set = 0;
+  switch (event) {
+    case ESP_GAP_BLE_EXT_ADV_SET_PARAMS_COMPLETE_EVT:
+      if (!this->pop_pending(OP_PARAMS, set)) {
+        break;
+      }
+      if (param->ext_adv_set_params.status != ESP_BT_STATUS_SUCCESS) {
+        ESP_LOGW(TAG, "Extended advertising set %d refused: %d, using %d sets", set, param->ext_adv_set_params.status, this->nb_sets_);
+      } else if (set == this->nb_sets_) {
+        this->nb_sets_++;
+      }
+      break;
+    case ESP_GAP_BLE_EXT_ADV_DATA_SET_COMPLETE_EVT:
+      if (this->pop_pending(OP_DATA, set)) {
+        this->handler_->on_config_complete(set, param->ext_adv_data_set.status == ESP_BT_STATUS_SUCCESS);
+      }
+      break;
+    case ESP_GAP_BLE_EXT_ADV_START_COMPLETE_EVT:
+      if (this->pop_pending(OP_START, set)) {
+        this->handler_->on_start_complete(set, param->ext_adv_start.status == ESP_BT_STATUS_SUCCESS);
+      }
+      break;
+    case ESP_GAP_BLE_EXT_ADV_STOP_COMPLETE_EVT:
+      if (this->pop_pending(OP_STOP, set)) {
+        this->handler_->on_stop_complete(set, param->ext_adv_stop.status == ESP_BT_STATUS_SUCCESS);
+      }
+      break;
+    default:
+      break;
+  }
+}
+#else
+void BleAdvEspLegacyGap::init(BleAdvHandler * handler, esp_ble_adv_params_t * params) {
+  this->params_ = params;
+  BleAdvEspGap::init(handler, params);
+}
+
+void BleAdvEspLegacyGap::gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) {
+  switch (event) {
+    case ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT:
+      this->handler_->on_config_complete(0, param->adv_data_raw_cmpl.status == ESP_BT_STATUS_SUCCESS);
+      break;
+    case ESP_GAP_BLE_ADV_START_COMPLETE_EVT:
+      this->handler_->on_start_complete(0, param->adv_start_cmpl.status == ESP_BT_STATUS_SUCCESS);
+      break;
+    case ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT:
+      this->handler_->on_stop_complete(0, param->adv_stop_cmpl.status == ESP_BT_STATUS_SUCCESS);
+      break;
+    default:
+      break;
+  }
+}
+#endif
+
 void BleAdvHandler::setup() {
+  // Only allocation of the advertiser queue, no more allocation needed when processing
+  this->packets_.init(this->queue_capacity_);
+  esp32_ble::global_ble->register_gap_event_handler(this);
 #ifdef USE_API
   register_service(&BleAdvHandler::on_raw_decode, "raw_decode", {"raw"});
+  register_service(&BleAdvHandler::dump_trace, "dump_trace");
 #endif
 }
 
 void BleAdvHandler::add_encoder(BleAdvEncoder * encoder) { 
-  BleAdvMultiEncoder * enc_all = nullptr;
-  auto all_enc = std::find_if(this->encoders_.begin(), this->encoders_.end(), 
-                    [&](BleAdvEncoder * p){ return p->is_id(encoder->get_encoding(), "All"); });
-  if (all_enc == this->encoders_.end()) {
-    enc_all = new BleAdvMultiEncoder(encoder->get_encoding());
-    this->encoders_.push_back(enc_all);
-  } else {
-    enc_all = static_cast<BleAdvMultiEncoder*>(*all_enc);
+  if (this->encoders_.size() + 2 > NO_HANDLE) {
+    ESP_LOGE(TAG, "Too many encoders, %s not registered", encoder->get_id().c_str());
+    return;
   }
+  uint8_t enc_handle = this->get_encoding_handle(encoder->get_encoding());
+  if (enc_handle == NO_HANDLE) {
+    // first encoder of the encoding: intern it, with its 'All' encoder
+    enc_handle = this->encodings_.size();
+    this->encodings_.push_back(encoder->get_encoding());
+    this->encoding_handles_.emplace_back(1, this->encoders_.size());
+    this->encoders_.push_back(new BleAdvMultiEncoder(encoder->get_encoding()));
+  }
+  auto enc_all = static_cast<BleAdvMultiEncoder*>(this->encoders_[this->encoding_handles_[enc_handle].front()]);
+  encoder->init_capabilities();
+  this->encoding_handles_[enc_handle].push_back(this->encoders_.size());
   this->encoders_.push_back(encoder);
   enc_all->add_encoder(encoder);
+
+  // index the encoder by adv data length, for decoding
+  size_t len = encoder->get_data_len();
+  if ((len == 0) || (len >= MAX_PACKET_LEN)) {
+    return;
+  }
+  auto pos = std::upper_bound(this->decoders_.begin(), this->decoders_.end(), len,
+                  [](size_t len, BleAdvEncoder * p){ return len < p->get_data_len(); });
+  this->decoders_.insert(pos, encoder);
+  for (size_t i = len + 1; i <= MAX_PACKET_LEN; ++i) {
+    this->decoders_start_[i]++;
+  }
 }
 
 BleAdvEncoder * BleAdvHandler::get_encoder(const std::string & id) {
@@ -190,39 +708,269 @@ BleAdvEncoder * BleAdvHandler::get_encoder(const std::string & encoding, const s
   return nullptr;
 }
 
-std::vector<std::string> BleAdvHandler::get_ids(const std::string & encoding) {
-  std::vector<std::string> ids;
-  for(auto & encoder : this->encoders_) {
-    if (encoder->is_encoding(encoding)) {
-      ids.push_back(encoder->get_id());
+uint8_t BleAdvHandler::get_encoding_handle(const std::string & encoding) const {
+  auto it = std::find(this->encodings_.begin(), this->encodings_.end(), encoding);
+  return (it == this->encodings_.end()) ? NO_HANDLE : (it - this->encodings_.begin());
+}
+
+const std::vector< uint8_t > & BleAdvHandler::get_handles(uint8_t encoding_handle) const {
+  static const std::vector< uint8_t > NO_HANDLES;
+  return (encoding_handle < this->encoding_handles_.size()) ? this->encoding_handles_[encoding_handle] : NO_HANDLES;
+}
+
+void BleAdvHandler::trace(BleAdvTrace::Event event, uint16_t msg_id, const uint8_t * data, uint8_t len) {
+  if (this->trace_capacity_ == 0) {
+    return;
+  }
+  if (!this->trace_.is_init()) {
+    this->trace_.init(this->trace_capacity_);
+  }
+  this->trace_.add(event, msg_id, data, len);
+}
+
+void BleAdvHandler::dump_trace() {
+  this->trace_.dump(TAG);
+}
+
+uint32_t BleAdvHandler::get_airtime(uint32_t now) const {
+  uint32_t airtime = this->airtime_;
+  for (uint8_t i = 0; i < this->nb_sets_; ++i) {
+    if (this->sets_[i].on_air_) {
+      airtime += now - this->sets_[i].on_air_since_;
     }
   }
-  return ids;
+  return airtime;
+}
+
+uint8_t BleAdvHandler::register_flow(uint8_t weight) {
+  this->flows_.emplace_back();
+  this->flows_.back().weight_ = std::max(weight, (uint8_t)1);
+  return this->flows_.size() - 1;
 }
 
-uint16_t BleAdvHandler::add_to_advertiser(std::vector< BleAdvParam > & params) {
-  uint32_t msg_id = ++this->id_count;
+uint16_t BleAdvHandler::add_to_advertiser(std::vector< BleAdvParam > & params, uint8_t flow, uint8_t priority) {
+#if ESPHOME_LOG_LEVEL >= ESPHOME_LOG_LEVEL_DEBUG
   for (auto & param : params) {
-    this->packets_.emplace_back(BleAdvProcess(msg_id, std::move(param)));
-    ESP_LOGD(TAG, "request start advertising - %ld: %s", msg_id, 
+    ESP_LOGD(TAG, "request start advertising: %s", 
                 esphome::format_hex_pretty(param.get_full_buf(), param.get_full_len()).c_str());
   }
-  params.clear(); // As we moved the content, just to be sure no caller will re use it
-  return this->id_count;
+#endif
+  if (flow < this->flows_.size()) {
+    // a flow becoming active again does not benefit from the airtime it did not use
+    BleAdvFlow & bflow = this->flows_[flow];
+    if ((int32_t)(bflow.vtime_ - this->vclock_) < 0) {
+      bflow.vtime_ = this->vclock_;
+    }
+  }
+  uint16_t msg_id = this->packets_.push(params, flow, priority, millis());
+  // the move of the params is a copy, their content is still available
+  for (auto & param : params) {
+    this->trace((msg_id == 0) ? BleAdvTrace::DROP : BleAdvTrace::REQUEST, msg_id, param.get_full_buf(), param.get_full_len());
+  }
+  if (msg_id == 0) {
+    this->nb_dropped_ += params.size();
+    ESP_LOGW(TAG, "Advertiser queue full (%d packets), %d packets dropped", this->packets_.capacity(), params.size());
+  } else {
+    ESP_LOGD(TAG, "advertising - %d", msg_id);
+    params.clear(); // As we moved the content, just to be sure no caller will re use it
+  }
+  this->update_switch_pending();
+  this->advertise_waiting();
+  return msg_id;
 }
 
 void BleAdvHandler::remove_from_advertiser(uint16_t msg_id) {
   ESP_LOGD(TAG, "request stop advertising - %d", msg_id);
-  for (auto & param : this->packets_) {
-    if (param.id_ == msg_id) {
-      param.to_be_removed_ = true;
+  this->packets_.remove(msg_id);
+  this->update_switch_pending();
+}
+
+uint16_t BleAdvHandler::replace_in_advertiser(uint16_t msg_id, std::vector< BleAdvParam > & params, uint8_t flow, uint8_t priority) {
+  ESP_LOGD(TAG, "request stop advertising - %d", msg_id);
+  this->packets_.remove(msg_id);
+  if (!this->has_room(params.size())) {
+    this->update_switch_pending();
+    return 0;
+  }
+  return this->add_to_advertiser(params, flow, priority);
+}
+
+bool BleAdvHandler::is_advertised(uint16_t msg_id) {
+  uint8_t index = msg_id & 0xFF;
+  if ((msg_id == 0) || (index >= this->packets_.capacity())) {
+    return true;
+  }
+  BleAdvProcess & slot = this->packets_.at(index);
+  return (slot.id_ != msg_id) || slot.processed_once_;
+}
+
+// Time in ns and heap allocations per call of fn, run by batches for the watchdog to be fed in between.
+// The allocations are -1 if not counted.
+struct BenchResult {
+  uint32_t ns_;
+  float allocs_;
+};
+static constexpr uint32_t BENCH_BATCH = 500;
+
+template< class Fn >
+static BenchResult bench(uint32_t nb_loops, uint32_t (*alloc_counter)(), Fn && fn) {
+  uint32_t elapsed_us = 0;
+  uint32_t allocs = 0;
+  for (uint32_t done = 0; done < nb_loops; done += BENCH_BATCH) {
+    uint32_t end = std::min(done + BENCH_BATCH, nb_loops);
+    uint32_t start_allocs = (alloc_counter != nullptr) ? alloc_counter() : 0;
+    uint32_t start = micros();
+    for (uint32_t i = done; i < end; ++i) {
+      fn(i);
+    }
+    elapsed_us += micros() - start;
+    allocs += (alloc_counter != nullptr) ? alloc_counter() - start_allocs : 0;
+    App.feed_wdt();
+  }
+  return { (uint32_t)(1000ULL * elapsed_us / nb_loops), (alloc_counter != nullptr) ? (float)allocs / nb_loops : -1.0f };
+}
+
+void BleAdvHandler::benchmark_encoders(uint32_t nb_loops) {
+  nb_loops = std::max(nb_loops, (uint32_t)1);
+
+  // primitives on a packet of the usual size, through any encoder as they do not depend on it
+  auto it = std::find_if(this->encoders_.begin(), this->encoders_.end(), [](BleAdvEncoder * enc) { return enc->get_data_len() != 0; });
+  if (it != this->encoders_.end()) {
+    BleAdvEncoder * enc = *it;
+    uint8_t buf[24];
+    for (size_t i = 0; i < sizeof(buf); ++i) {
+      buf[i] = i * 37;
+    }
+    volatile uint16_t crc = 0;
+    const std::pair< const char *, BenchResult > primitives[] = {
+      {"whiten", bench(nb_loops, this->alloc_counter_, [&](uint32_t) { enc->whiten(buf, sizeof(buf), 0x37); })},
+      {"whiten_lfsr", bench(nb_loops, this->alloc_counter_, [&](uint32_t) { enc->whiten(buf, sizeof(buf), 0x12); })},
+      {"reverse_all", bench(nb_loops, this->alloc_counter_, [&](uint32_t) { enc->reverse_all(buf, sizeof(buf)); })},
+      {"crc16_8408", bench(nb_loops, this->alloc_counter_, [&](uint32_t) { crc = enc->crc16_8408(buf, sizeof(buf), crc); })},
+      {"crc16_1021", bench(nb_loops, this->alloc_counter_, [&](uint32_t) { crc = enc->crc16_1021(buf, sizeof(buf), crc); })},
+    };
+    for (auto & primitive : primitives) {
+      ESP_LOGI(TAG, "{\"primitive\":\"%s\",\"loops\":%ld,\"ns\":%ld,\"allocs\":%.2f}",
+                primitive.first, nb_loops, primitive.second.ns_, primitive.second.allocs_);
+    }
+  }
+
+  for (auto & encoder : this->encoders_) {
+    if (encoder->get_data_len() == 0) {
+      continue; // 'All' encoders are only a sum of the others
+    }
+    Command cmd(CommandType::LIGHT_ON);
+    ControllerParam_t cont;
+    cont.id_ = 0x123456;
+    std::vector< BleAdvParam > params;
+
+    BenchResult translate = bench(nb_loops, this->alloc_counter_, [&](uint32_t) { encoder->translate(cmd, cont); });
+    BenchResult encode = bench(nb_loops, this->alloc_counter_, [&](uint32_t) {
+      params.clear();
+      encoder->encode(params, cmd, cont);
+    });
+    if (params.empty()) {
+      continue;
+    }
+
+    // decode of a valid packet, and of a packet with the same header but corrupted content
+    BleAdvParam & hit = params.back();
+    BleAdvParam miss;
+    miss.from_raw(hit.get_full_buf(), hit.get_full_len());
+    miss.get_full_buf()[miss.get_full_len() - 1] ^= 0xFF;
+    Command dec_cmd;
+    ControllerParam_t dec_cont;
+    BenchResult decode_hit = bench(nb_loops, this->alloc_counter_, [&](uint32_t) { encoder->decode(hit, dec_cmd, dec_cont); });
+    BenchResult decode_miss = bench(nb_loops, this->alloc_counter_, [&](uint32_t) { encoder->decode(miss, dec_cmd, dec_cont); });
+
+    // signature with a new key at each call, 0 if not signing
+    uint8_t sign_buf[16]{0};
+    BenchResult sign{0, 0.0f};
+    if (encoder->benchmark_sign(sign_buf, 0)) {
+      sign = bench(nb_loops, this->alloc_counter_, [&](uint32_t i) { encoder->benchmark_sign(sign_buf, i + 1); });
+    }
+
+    ESP_LOGI(TAG, "{\"encoder\":\"%s\",\"loops\":%ld,\"translate_ns\":%ld,\"encode_ns\":%ld,\"decode_hit_ns\":%ld,\"decode_miss_ns\":%ld,"
+                  "\"sign_ns\":%ld,\"translate_allocs\":%.2f,\"encode_allocs\":%.2f,\"decode_allocs\":%.2f}",
+              encoder->get_id().c_str(), nb_loops, translate.ns_, encode.ns_, decode_hit.ns_, decode_miss.ns_, sign.ns_,
+              translate.allocs_, encode.allocs_, decode_hit.allocs_);
+  }
+}
+
+// Re encoding with the decoded parameters to check if it gives the same output
+bool BleAdvHandler::check_reencode(BleAdvEncoder * encoder, const BleAdvParam & param, Command cmd, ControllerParam_t cont) {
+  std::vector< BleAdvParam > params;
+  cont.tx_count_--; // as the encoder will increase it automatically
+  if(cmd.cmd_ == 0x28) {
+    // Force recomputation of Args by translate function for PAIR command, as part of encoding
+    cmd.main_cmd_ = CommandType::PAIR;
+  }
+  encoder->encode(params, cmd, cont);
+  if (params.empty()) {
+    return false;
+  }
+  BleAdvParam & fparam = params.back();
+  ESP_LOGD(TAG, "enc - %s", esphome::format_hex_pretty(fparam.get_full_buf(), fparam.get_full_len()).c_str());
+  return (param.get_data_len() == fparam.get_data_len()) 
+      && std::equal(param.get_const_data_buf(), param.get_const_data_buf() + param.get_data_len(), fparam.get_data_buf());
+}
+
+uint32_t BleAdvHandler::check_encoders(uint32_t nb_loops) {
+  uint32_t nb_total_ko = 0;
+  for (auto & encoder : this->encoders_) {
+    if (encoder->get_data_len() == 0) {
+      continue; // 'All' encoders are only a sum of the others
     }
+    uint32_t nb_ok = 0;
+    uint32_t nb_ko = 0;
+    for (uint8_t type = 0; type < MAX_COMMAND_TYPE; ++type) {
+      Command cmd((CommandType)type);
+      if (!encoder->is_supported(cmd)) {
+        continue;
+      }
+      for (uint32_t i = 0; i < nb_loops; ++i) {
+        // random parameters, the identifier being valid for all encoders
+        for (auto & arg : cmd.args_) {
+          arg = rand() & 0xFF;
+        }
+        ControllerParam_t cont;
+        cont.id_ = rand() & 0xFFFF;
+        cont.index_ = rand() & 0xFF;
+        cont.tx_count_ = rand() & 0x7F;
+        std::vector< BleAdvParam > params;
+        encoder->encode(params, cmd, cont);
+        for (auto & param : params) {
+          Command dec_cmd(CommandType::CUSTOM);
+          ControllerParam_t dec_cont;
+          if (encoder->decode(param, dec_cmd, dec_cont) && this->check_reencode(encoder, param, dec_cmd, dec_cont)) {
+            nb_ok++;
+          } else {
+            nb_ko++;
+            ESP_LOGW(TAG, "%s - round trip failed for command %d: %s", encoder->get_id().c_str(), type,
+                      esphome::format_hex_pretty(param.get_full_buf(), param.get_full_len()).c_str());
+          }
+        }
+      }
+      App.feed_wdt();
+    }
+    ESP_LOGI(TAG, "%s - encode / decode / re-encode: %ld OK, %ld KO", encoder->get_id().c_str(), nb_ok, nb_ko);
+    nb_total_ko += nb_ko;
   }
+  return nb_total_ko;
 }
 
 // try to identify the relevant encoder
 bool BleAdvHandler::identify_param(const BleAdvParam & param, bool ignore_ble_param) {
-  for(auto & encoder : this->encoders_) {
+  // Only the encoders with the same data length and header can decode it
+  if (!param.has_data() || (param.get_data_len() >= MAX_PACKET_LEN)) {
+    return false;
+  }
+  size_t len = param.get_data_len();
+  for (size_t i = this->decoders_start_[len]; i < this->decoders_start_[len + 1]; ++i) {
+    BleAdvEncoder * encoder = this->decoders_[i];
+    if (!encoder->is_header(param.get_const_data_buf())) {
+      continue;
+    }
     if (!ignore_ble_param && !encoder->is_ble_param(param.get_ad_flag(), param.get_data_type())) {
       continue;
     }
@@ -232,6 +980,7 @@ bool BleAdvHandler::identify_param(const BleAdvParam & param, bool ignore_ble_pa
       ESP_LOGI(encoder->get_id().c_str(), "Decoded OK - tx: %d, cmd: '0x%02X', Args: [%d,%d,%d,%d]",
                cont.tx_count_, cmd.cmd_, cmd.args_[0], cmd.args_[1], cmd.args_[2], cmd.args_[3]);
 
+#if ESPHOME_LOG_LEVEL >= ESPHOME_LOG_LEVEL_INFO
       std::string config_str = "config: \nble_adv_controller:";
       config_str += "\n  - id: my_controller_id";
       config_str += "\n    encoding: %s";
@@ -241,18 +990,9 @@ bool BleAdvHandler::identify_param(const BleAdvParam & param, bool ignore_ble_pa
         config_str += "\n    index: %d";
       }
       ESP_LOGI(TAG, config_str.c_str(), encoder->get_encoding().c_str(), encoder->get_variant().c_str(), cont.id_, cont.index_);
+#endif
       
-      // Re encoding with the same parameters to check if it gives the same output
-      std::vector< BleAdvParam > params;
-      cont.tx_count_--; // as the encoder will increase it automatically
-      if(cmd.cmd_ == 0x28) {
-        // Force recomputation of Args by translate function for PAIR command, as part of encoding
-        cmd.main_cmd_ = CommandType::PAIR;
-      }
-      encoder->encode(params, cmd, cont);
-      BleAdvParam & fparam = params.back();
-      ESP_LOGD(TAG, "enc - %s", esphome::format_hex_pretty(fparam.get_full_buf(), fparam.get_full_len()).c_str());
-      if (std::equal(param.get_const_data_buf(), param.get_const_data_buf() + param.get_data_len(), fparam.get_data_buf())) {
+      if (this->check_reencode(encoder, param, cmd, cont)) {
         ESP_LOGI(TAG, "Decoded / Re-encoded with NO DIFF");
       } else {
         ESP_LOGE(TAG, "DIFF after Decode / Re-encode");
@@ -285,8 +1025,11 @@ public:
 };
 
 void BleAdvHandler::capture(const esp32_ble_tracker::ESPBTDevice & device, bool ignore_ble_param, uint16_t rem_time) {
-  // Clean-up expired packets
-  this->listen_packets_.remove_if( [&](BleAdvParam & p){ return p.duration_ < millis(); } );
+  // Only allocated if capture is used
+  if (!this->captured_.is_init()) {
+    this->captured_.init(this->capture_capacity_);
+    this->capture_queue_.init(this->capture_queue_size_);
+  }
 
   // Read raw advertised packets
   BleAdvParam param;
@@ -294,45 +1037,374 @@ void BleAdvHandler::capture(const esp32_ble_tracker::ESPBTDevice & device, bool
   hack_device->get_raw_packet(param);
   if (!param.has_data()) return;
 
-  // Check if not already received in the last 300s
-  auto idx = std::find(this->listen_packets_.begin(), this->listen_packets_.end(), param);
-  if (idx == this->listen_packets_.end()) {
-    ESP_LOGD(TAG, "raw - %s", esphome::format_hex_pretty(param.get_full_buf(), param.get_full_len()).c_str());
-    param.duration_ = millis() + (uint32_t)rem_time * 1000;
-    this->identify_param(param, ignore_ble_param);
-    this->listen_packets_.emplace_back(std::move(param));
+  // Check if not already received in the last rem_time seconds, decoding deferred to the loop
+  if (!this->captured_.add(param, millis(), (uint32_t)rem_time * 1000)) {
+    return;
+  }
+  if (!this->capture_queue_.push(param, ignore_ble_param)) {
+    // forget it to have it processed when received again
+    this->captured_.pop_newest();
+    this->capture_dropped_++;
+    return;
   }
+  this->capture_queue_max_ = std::max(this->capture_queue_max_, this->capture_queue_.size());
 }
 #endif
 
-void BleAdvHandler::loop() {
-  if (this->adv_stop_time_ == 0) {
-    // No packet is being advertised, process with clean-up IF already processed once and requested for removal
-    this->packets_.remove_if([&](BleAdvProcess & p){ return p.processed_once_ && p.to_be_removed_; } );
-    // if packets to be advertised, advertise the front one
-    if (!this->packets_.empty()) {
-      BleAdvParam & packet = this->packets_.front().param_;
-      ESP_ERROR_CHECK_WITHOUT_ABORT(esp_ble_gap_config_adv_data_raw(packet.get_full_buf(), packet.get_full_len()));
-      ESP_ERROR_CHECK_WITHOUT_ABORT(esp_ble_gap_start_advertising(&(this->adv_params_)));
-      this->adv_stop_time_ = millis() + this->packets_.front().param_.duration_;
-      this->packets_.front().processed_once_ = true;
+void BleAdvHandler::set_state(BleAdvSet & set, AdvState state) {
+  set.state_ = state;
+  // While advertising, the transitions are waiting for GAP events processed in the main loop: have it run at full speed
+  if (state != AdvState::IDLE) {
+    this->high_freq_.start();
+  }
+}
+
+// Packets waiting with the same payload as the one on air are advertised along with it, by the same set:
+// their advertising window is opened in place, and the set is handed over to them if its packet is to be removed.
+void BleAdvHandler::merge_same_payload(uint8_t set_index) {
+  BleAdvSet & set = this->sets_[set_index];
+  AdvState state = set.state_;
+  if ((state != AdvState::ADVERTISING) && (state != AdvState::EXPIRED)) {
+    return;
+  }
+  bool extend = false;
+  uint8_t along = BleAdvQueue::NO_SLOT;
+  for (uint8_t index = 0; index < this->packets_.capacity(); ++index) {
+    BleAdvProcess & slot = this->packets_.at(index);
+    if ((index == set.slot_) || (slot.id_ == 0)) {
+      continue;
+    }
+    if (!slot.on_air() && set.is_configured(slot.param_)) {
+      slot.set_ = set_index;
+      this->nb_on_air_++;
+      if (!slot.processed_once_) {
+        slot.processed_once_ = true;
+        extend = true;
+        this->nb_config_skipped_++;
+      }
     }
+    if (slot.set_ == set_index) {
+      if (slot.to_be_removed_) {
+        this->release_slot(index);
+      } else {
+        along = index;
+      }
+    }
+  }
+  if ((along != BleAdvQueue::NO_SLOT) && this->packets_.at(set.slot_).to_be_removed_) {
+    this->release_slot(set.slot_);
+    set.slot_ = along;
+  }
+  // The window expired with the packet kept on air: re open it for the new ones
+  if (extend) {
+    ESP_LOGV(TAG, "same payload kept on air, reconfigurations avoided: %d", this->nb_config_skipped_);
+    if (this->cas_state(set, AdvState::EXPIRED, AdvState::ADVERTISING)) {
+      this->gap_->start_timer(set_index, this->packets_.at(set.slot_).param_.duration_);
+    }
+  }
+}
+
+void BleAdvHandler::update_switch_pending() {
+  for (uint8_t i = 0; i < this->nb_sets_; ++i) {
+    if (this->sets_[i].slot_ != BleAdvQueue::NO_SLOT) {
+      this->merge_same_payload(i);
+    }
+  }
+
+  // Switch to be done when the advertising window of a set expires in case:
+  // There are packets waiting to be advertised OR the packet of the set was requested to be removed
+  // The packets that will be taken by the idle sets are not waiting
+  size_t waiting = this->packets_.size() - this->nb_on_air_;
+  for (uint8_t i = 0; (i < this->nb_sets_) && (waiting > 0); ++i) {
+    if (this->sets_[i].state_ == AdvState::IDLE) waiting--;
+  }
+  for (uint8_t i = 0; i < this->nb_sets_; ++i) {
+    BleAdvSet & set = this->sets_[i];
+    bool to_be_removed = (set.slot_ != BleAdvQueue::NO_SLOT) && this->packets_.at(set.slot_).to_be_removed_;
+    set.switch_pending_ = to_be_removed || (waiting > 0);
+    // The window may already be expired, with the packet kept on air waiting for a new one
+    if (set.switch_pending_ && this->request_stop(i, AdvState::EXPIRED)) {
+      this->high_freq_.start();
+      if (!to_be_removed) waiting--;
+    }
+  }
+}
+
+bool BleAdvHandler::request_stop(uint8_t set, AdvState from) {
+  if (!this->cas_state(this->sets_[set], from, AdvState::STOPPING)) {
+    return false;
+  }
+  if (this->gap_->stop_advertising(set) != ESP_OK) {
+    // keep the packet on air, the stop will be retried on next queue update
+    this->cas_state(this->sets_[set], AdvState::STOPPING, AdvState::EXPIRED);
+    return false;
+  }
+  return true;
+}
+
+// Called from the timer task: no access to the queue nor to the GAP, only the state transition,
+// the stop being requested by the main loop
+void BleAdvHandler::on_adv_timer(uint8_t set) {
+  this->cas_state(this->sets_[set], AdvState::ADVERTISING, AdvState::EXPIRED);
+}
+
+void BleAdvHandler::release_slot(uint8_t index) {
+  BleAdvProcess & slot = this->packets_.at(index);
+  slot.set_ = BleAdvProcess::NO_SET;
+  this->nb_on_air_--;
+  if (slot.processed_once_ && slot.to_be_removed_) {
+    this->packets_.erase(index);
   } else {
-    // Packet is being advertised, check if time to switch to next one in case:
-    // The advertise seq_duration expired AND
-    // There is more than one packet to advertise OR the front packet was requested to be removed
-    bool multi_packets = (this->packets_.size() > 1);
-    bool front_to_be_removed = this->packets_.front().to_be_removed_;
-    if ((millis() > this->adv_stop_time_) && (multi_packets || front_to_be_removed)) {
-      ESP_ERROR_CHECK_WITHOUT_ABORT(esp_ble_gap_stop_advertising());
-      this->adv_stop_time_ = 0;
-      if (front_to_be_removed) {
-        this->packets_.pop_front();
-      } else if (multi_packets) {
-        this->packets_.emplace_back(std::move(this->packets_.front()));
-        this->packets_.pop_front();
+    // back of the round robin order, behind the ones added while it was advertised
+    this->packets_.take(index);
+  }
+}
+
+void BleAdvHandler::release(uint8_t set_index) {
+  BleAdvSet & set = this->sets_[set_index];
+  if (set.slot_ == BleAdvQueue::NO_SLOT) {
+    return;
+  }
+  ESP_LOGV(TAG, "off air - msg %d, set %d", this->packets_.at(set.slot_).id_, set_index);
+  this->trace(BleAdvTrace::OFF_AIR, this->packets_.at(set.slot_).id_, &set_index, 1);
+  if (set.on_air_) {
+    this->airtime_ += millis() - set.on_air_since_;
+    set.on_air_ = false;
+  }
+  this->release_slot(set.slot_);
+  set.slot_ = BleAdvQueue::NO_SLOT;
+  // and the ones advertised along with it
+  for (uint8_t index = 0; index < this->packets_.capacity(); ++index) {
+    if (this->packets_.at(index).set_ == set_index) {
+      this->release_slot(index);
+    }
+  }
+}
+
+void BleAdvHandler::advertise_waiting() {
+  for (uint8_t i = 0; (i < this->nb_sets_) && (this->packets_.size() > this->nb_on_air_); ++i) {
+    if (this->sets_[i].state_ == AdvState::IDLE) {
+      this->advertise_next(i);
+    }
+  }
+}
+
+void BleAdvHandler::advertise_next(uint8_t set_index) {
+  BleAdvSet & set = this->sets_[set_index];
+  uint8_t index = this->schedule();
+  if (index == BleAdvQueue::NO_SLOT) {
+    set.switch_pending_ = false;
+    this->set_state(set, AdvState::IDLE);
+    return;
+  }
+
+  BleAdvProcess & slot = this->packets_.at(index);
+  slot.set_ = set_index;
+  this->nb_on_air_++;
+  set.slot_ = index;
+
+  // The set already holds this payload: no need to configure it again
+  if (set.is_configured(slot.param_)) {
+    this->nb_config_skipped_++;
+    ESP_LOGV(TAG, "same payload restarted, reconfigurations avoided: %d", this->nb_config_skipped_);
+    this->start_set(set_index);
+    this->update_switch_pending();
+    return;
+  }
+
+  // configure the chosen packet, advertising started on configuration completion
+  set.configured_len_ = 0;
+  this->set_state(set, AdvState::CONFIGURING);
+  this->update_switch_pending();
+  if (this->gap_->config_adv_data_raw(set_index, slot.param_.get_full_buf(), slot.param_.get_full_len()) != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to configure advertising data");
+    this->release(set_index);
+    this->set_state(set, AdvState::IDLE);
+  }
+}
+
+void BleAdvHandler::start_set(uint8_t set_index) {
+  BleAdvSet & set = this->sets_[set_index];
+  this->set_state(set, AdvState::STARTING);
+  if (this->gap_->start_advertising(set_index) != ESP_OK) {
+    ESP_LOGW(TAG, "Failed to start advertising");
+    this->release(set_index);
+    this->set_state(set, AdvState::IDLE);
+  }
+}
+
+bool BleAdvHandler::is_before(BleAdvProcess & slot, BleAdvProcess & ref) {
+  if (this->policy_ == SchedulerPolicy::PRIORITY) {
+    // the class only applies until advertised once: the repetitions of a command kept on air are not urgent
+    uint8_t slot_prio = (slot.waits_ >= MAX_WAITS) ? 0xFF : (slot.processed_once_ ? 0 : slot.priority_);
+    uint8_t ref_prio = (ref.waits_ >= MAX_WAITS) ? 0xFF : (ref.processed_once_ ? 0 : ref.priority_);
+    if (slot_prio != ref_prio) {
+      return slot_prio > ref_prio;
+    }
+  }
+  // Weighted fair: the flow that consumed the least airtime relatively to its weight
+  // strictly less to keep the round robin order in between packets of a same flow
+  uint32_t slot_vtime = (slot.flow_ < this->flows_.size()) ? this->flows_[slot.flow_].vtime_ : this->vclock_;
+  uint32_t ref_vtime = (ref.flow_ < this->flows_.size()) ? this->flows_[ref.flow_].vtime_ : this->vclock_;
+  return (int32_t)(slot_vtime - ref_vtime) < 0;
+}
+
+// Choose the next packet to be advertised in the ones not already on air
+uint8_t BleAdvHandler::schedule() {
+  // Find the best candidate, in round robin order for equivalent ones
+  uint8_t best = BleAdvQueue::NO_SLOT;
+  uint8_t index = this->packets_.first();
+  for (size_t i = 0; i < this->packets_.size(); ++i) {
+    BleAdvProcess & slot = this->packets_.at(index);
+    if (!slot.on_air()) {
+      if (best == BleAdvQueue::NO_SLOT) {
+        best = index;
+        if (this->policy_ == SchedulerPolicy::ROUND_ROBIN) break;
+      } else if (this->is_before(slot, this->packets_.at(best))) {
+        best = index;
       }
     }
+    index = slot.next_;
+  }
+  if ((best == BleAdvQueue::NO_SLOT) || (this->policy_ == SchedulerPolicy::ROUND_ROBIN)) {
+    return best;
+  }
+
+  // Age the ones passed over
+  index = this->packets_.first();
+  for (size_t i = 0; i < this->packets_.size(); ++i) {
+    BleAdvProcess & slot = this->packets_.at(index);
+    if (index == best) {
+      slot.waits_ = 0;
+    } else if (!slot.on_air() && (slot.waits_ < 0xFF)) {
+      slot.waits_++;
+    }
+    index = slot.next_;
+  }
+
+  BleAdvProcess & slot = this->packets_.at(best);
+  if (slot.flow_ < this->flows_.size()) {
+    this->vclock_ = this->flows_[slot.flow_].vtime_;
+  }
+  return best;
+}
+
+void BleAdvHandler::on_config_complete(uint8_t set_index, bool success) {
+  BleAdvSet & set = this->sets_[set_index];
+  if (set.state_ != AdvState::CONFIGURING) return;
+  if (!success) {
+    ESP_LOGW(TAG, "Advertising data configuration failed");
+    this->release(set_index);
+    this->set_state(set, AdvState::IDLE);
+    return;
+  }
+  BleAdvParam & param = this->packets_.at(set.slot_).param_;
+  std::copy(param.get_full_buf(), param.get_full_buf() + param.get_full_len(), set.configured_buf_);
+  set.configured_len_ = param.get_full_len();
+  this->start_set(set_index);
+}
+
+void BleAdvHandler::on_start_complete(uint8_t set_index, bool success) {
+  BleAdvSet & set = this->sets_[set_index];
+  if (set.state_ != AdvState::STARTING) return;
+  if (!success) {
+    ESP_LOGW(TAG, "Advertising start failed");
+    this->release(set_index);
+    this->set_state(set, AdvState::IDLE);
+    return;
+  }
+  BleAdvProcess & slot = this->packets_.at(set.slot_);
+  uint32_t now = millis();
+  set.on_air_ = true;
+  set.on_air_since_ = now;
+  uint8_t air_data[2] = {set_index, slot.flow_};
+  this->trace(BleAdvTrace::ON_AIR, slot.id_, air_data, sizeof(air_data));
+  if (!slot.processed_once_) {
+    // on air timeline, to follow the latency of the requests and the sharing of the airtime
+    ESP_LOGV(TAG, "on air - msg %d, set %d, flow %d, %ld ms after request", 
+              slot.id_, set_index, slot.flow_, now - slot.submit_time_);
+    this->nb_advertised_++;
+    // latency of the command measured on the first packet of the message
+    if ((set.slot_ == (slot.id_ & 0xFF)) && (slot.flow_ < this->flows_.size())) {
+      this->flows_[slot.flow_].latency_.add(now - slot.submit_time_);
+    }
+  }
+  slot.processed_once_ = true;
+  if (slot.flow_ < this->flows_.size()) {
+    BleAdvFlow & flow = this->flows_[slot.flow_];
+    flow.vtime_ += slot.param_.duration_ * VTIME_SCALE / flow.weight_;
+  }
+  this->set_state(set, AdvState::ADVERTISING);
+  this->update_switch_pending();
+  this->gap_->start_timer(set_index, slot.param_.duration_);
+}
+
+void BleAdvHandler::on_stop_complete(uint8_t set_index, bool success) {
+  BleAdvSet & set = this->sets_[set_index];
+  if (set.state_ != AdvState::STOPPING) return;
+  this->release(set_index);
+  this->advertise_next(set_index);
+}
+
+void BleAdvHandler::gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) {
+  this->gap_->gap_event_handler(event, param);
+}
+
+void BleAdvHandler::loop() {
+  // The GAP is initialized once the BLE stack is enabled by esp32_ble, in its loop,
+  // the sets becoming usable when the controller accepts their parameters
+  if (!this->gap_init_ && esp32_ble::global_ble->is_active()) {
+    this->gap_->init(this, &(this->adv_params_));
+    this->gap_init_ = true;
+  }
+  if (this->gap_init_) {
+    this->nb_sets_ = std::min(this->gap_->get_nb_sets(), MAX_ADV_SETS);
+  }
+
+  // Switch the sets whose advertising window expired
+  for (uint8_t i = 0; i < this->nb_sets_; ++i) {
+    if (this->sets_[i].switch_pending_) {
+      this->request_stop(i, AdvState::EXPIRED);
+    }
+  }
+
+  // The Advertiser is driven by GAP events, only retry after a failure
+  // or release the main loop if no set is waiting for a GAP event, or for a switch at the expiry of its window
+  bool waiting_event = false;
+  for (uint8_t i = 0; i < this->nb_sets_; ++i) {
+    AdvState state = this->sets_[i].state_;
+    waiting_event |= (state == AdvState::CONFIGURING) || (state == AdvState::STARTING) || (state == AdvState::STOPPING);
+    waiting_event |= this->sets_[i].switch_pending_ && ((state == AdvState::ADVERTISING) || (state == AdvState::EXPIRED));
+  }
+  if (!waiting_event) {
+    this->high_freq_.stop();
+  }
+  this->advertise_waiting();
+  this->decode_captured();
+}
+
+void BleAdvHandler::decode_captured() {
+  // At least one per loop, then until the time budget is consumed
+  uint32_t start = micros();
+  BleAdvCaptureQueue::Item * item = nullptr;
+  while ((item = this->capture_queue_.front()) != nullptr) {
+    BleAdvParam & param = item->param_;
+    ESP_LOGD(TAG, "raw - %s", esphome::format_hex_pretty(param.get_full_buf(), param.get_full_len()).c_str());
+    if (this->identify_param(param, item->ignore_ble_param_)) {
+      this->capture_decoded_++;
+      this->trace(BleAdvTrace::DECODED, 0, param.get_full_buf(), param.get_full_len());
+    } else {
+      this->capture_rejected_++;
+      this->trace(BleAdvTrace::REJECTED, 0, param.get_full_buf(), param.get_full_len());
+    }
+    this->capture_queue_.pop();
+    if (micros() - start > CAPTURE_BUDGET_US) {
+      break;
+    }
+  }
+  if (this->capture_dropped_ != this->capture_dropped_logged_) {
+    ESP_LOGW(TAG, "Capture queue full, %ld packets dropped (max queue depth %d)", this->capture_dropped_, this->capture_queue_max_);
+    this->capture_dropped_logged_ = this->capture_dropped_;
   }
 }
 
@@ -3,11 +3,16 @@
 #include "esphome/core/defines.h"
 #include "esphome/core/component.h"
 #include "esphome/core/helpers.h"
+#include "esphome/core/log.h"
+#include "esphome/components/esp32_ble/ble.h"
 #ifdef USE_API
 #include "esphome/components/api/custom_api_device.h"
 #endif
 
 #include <esp_gap_ble_api.h>
+#include <esp_timer.h>
+#include <atomic>
+#include <cstdint>
 #include <vector>
 #include <list>
 
@@ -40,6 +45,7 @@ enum CommandType {
   FAN_DIR = 34,
   FAN_OSC = 35,
 };
+static constexpr uint8_t MAX_COMMAND_TYPE = 64;
 
 /**
   Command: 
@@ -55,6 +61,40 @@ public:
   uint8_t args_[4]{0};
 };
 
+/**
+  Commands: result of an encoder translation, stored inline to avoid any heap allocation
+  on the encoding path. An encoder translates a command into at most MAX_COMMANDS commands.
+ */
+class Commands
+{
+public:
+  static constexpr size_t MAX_COMMANDS = 2;
+
+  bool empty() const { return this->size_ == 0; }
+  size_t size() const { return this->size_; }
+  // false with a warning if full, the command being dropped
+  bool emplace_back(const Command & cmd) {
+    if (this->size_ >= MAX_COMMANDS) {
+      log_dropped(cmd);
+      return false;
+    }
+    this->cmds_[this->size_++] = cmd;
+    return true;
+  }
+  Command & operator[](size_t i) { return this->cmds_[i]; }
+  const Command & operator[](size_t i) const { return this->cmds_[i]; }
+  Command * begin() { return this->cmds_; }
+  Command * end() { return this->cmds_ + this->size_; }
+  const Command * begin() const { return this->cmds_; }
+  const Command * end() const { return this->cmds_ + this->size_; }
+
+protected:
+  static void log_dropped(const Command & cmd);
+
+  Command cmds_[MAX_COMMANDS];
+  size_t size_{0};
+};
+
 /**
   Controller Parameters
  */
@@ -105,21 +145,176 @@ protected:
 class BleAdvProcess
 {
 public:
-  BleAdvProcess(uint32_t id, BleAdvParam && param): param_(std::move(param)), id_(id) {}
   BleAdvParam param_;
-  uint32_t id_{0};
+  uint16_t id_{0};
   bool processed_once_{false};
   bool to_be_removed_{false};
 
-  // Only move operators to avoid data copy
-  BleAdvProcess(BleAdvProcess&&) = default;
-  BleAdvProcess& operator=(BleAdvProcess&&) = default;
-} ;
+  // advertising set the packet is on air with, NO_SET if waiting
+  static constexpr uint8_t NO_SET = 0xFF;
+  uint8_t set_{NO_SET};
+  bool on_air() const { return this->set_ != NO_SET; }
+
+  // scheduling: flow (controller) of the packet, priority class and number of times it was passed over
+  uint8_t flow_{0};
+  uint8_t priority_{0};
+  uint8_t waits_{0};
+
+  // time the packet was requested, for the on air timeline
+  uint32_t submit_time_{0};
+
+  // links in the BleAdvQueue
+  uint8_t next_{0};
+  uint8_t prev_{0};
+  uint8_t next_msg_{0};
+};
+
+/**
+  BleAdvQueue: 
+    Fixed capacity pool of BleAdvProcess, allocated once at setup.
+    The slots being advertised are chained as a circular list in round robin order:
+      taking the first one for advertising is only an index bump, removal is unlinking the slot.
+    The message id embeds the index of the first slot of the message for direct access.
+ */
+class BleAdvQueue
+{
+public:
+  static constexpr uint8_t NO_SLOT = 0xFF;
+  static constexpr size_t MAX_CAPACITY = NO_SLOT;
+
+  void init(size_t capacity);
+  size_t capacity() const { return this->slots_.size(); }
+  size_t size() const { return this->size_; }
+  bool empty() const { return this->size_ == 0; }
+
+  // move the params in free slots, at the back of the circular list. Returns the msg id, 0 if no room
+  uint16_t push(std::vector< BleAdvParam > & params, uint8_t flow = 0, uint8_t priority = 0, uint32_t submit_time = 0);
+  // first slot in the round robin order
+  uint8_t first() const { return this->cur_; }
+  BleAdvProcess & at(uint8_t index) { return this->slots_[index]; }
+  // the slot was advertised: moved at the back of the round robin order
+  void take(uint8_t index);
+  void erase(uint8_t index) { this->unlink(index); }
+  // request the removal of the packets of a message, effective immediately for the ones already processed once
+  void remove(uint16_t msg_id);
+
+protected:
+  void unlink(uint8_t index);
+
+  std::vector< BleAdvProcess > slots_;
+  uint8_t cur_{NO_SLOT};
+  uint8_t free_{NO_SLOT};
+  size_t size_{0};
+  uint8_t gen_{0};
+};
+
+/**
+  BleAdvCaptureCache:
+    Fixed capacity set of the packets already captured, allocated once at first use.
+    The entries are stored in a ring in insertion order, which is also the expiry order for a constant retention:
+      the expired / oldest ones are dropped from the head of the ring.
+    They are indexed by an open addressing hash table of at least twice the capacity, with linear probing.
+ */
+class BleAdvCaptureCache
+{
+public:
+  static constexpr size_t MAX_CAPACITY = 1024;
+
+  void init(size_t capacity);
+  bool is_init() const { return !this->ring_.empty(); }
+  size_t size() const { return this->count_; }
+
+  // add the packet if not already in the cache, until now + retention. Returns false if already in the cache
+  bool add(BleAdvParam & param, uint32_t now, uint32_t retention_ms);
+  // forget the last added packet
+  void pop_newest();
+
+protected:
+  static constexpr uint16_t EMPTY = 0xFFFF;
+  struct Entry {
+    uint32_t hash_;
+    uint32_t expiry_;
+    uint8_t len_;
+    uint8_t buf_[MAX_PACKET_LEN];
+  };
+
+  static uint32_t hash(const uint8_t * buf, size_t len);
+  void unindex(uint16_t index);
+  void pop_oldest();
+
+  std::vector< Entry > ring_;
+  std::vector< uint16_t > table_;
+  size_t mask_{0};
+  size_t head_{0};
+  size_t count_{0};
+};
+
+/**
+  BleAdvCaptureQueue:
+    Lock free single producer / single consumer ring of the captured packets waiting to be decoded,
+    filled by the tracker callback and drained by the handler loop. Fixed capacity, allocated once at first use.
+ */
+class BleAdvCaptureQueue
+{
+public:
+  struct Item {
+    BleAdvParam param_;
+    bool ignore_ble_param_{true};
+  };
+
+  void init(size_t capacity) { this->items_.resize(std::max(capacity, (size_t)1)); }
+  bool is_init() const { return !this->items_.empty(); }
+  size_t size() const { return this->tail_.load(std::memory_order_acquire) - this->head_.load(std::memory_order_acquire); }
+
+  // producer
+  bool push(BleAdvParam & param, bool ignore_ble_param);
+  // consumer: nullptr if empty
+  Item * front();
+  void pop() { this->head_.fetch_add(1, std::memory_order_release); }
+
+protected:
+  std::vector< Item > items_;
+  // free running counters, the index in items_ being modulo its size
+  std::atomic< size_t > head_{0};
+  std::atomic< size_t > tail_{0};
+};
+
+/**
+  BleAdvTrace:
+    Fixed capacity ring of the last advertising events, allocated once at first use.
+    The records are only raw bytes, formatted when dumped: cheap enough to be always on.
+ */
+class BleAdvTrace
+{
+public:
+  enum Event: uint8_t { REQUEST, DROP, ON_AIR, OFF_AIR, DECODED, REJECTED };
+
+  void init(size_t capacity) { this->records_.resize(std::max(capacity, (size_t)1)); }
+  bool is_init() const { return !this->records_.empty(); }
+  size_t size() const { return std::min(this->count_, this->records_.size()); }
+
+  void add(Event event, uint16_t msg_id, const uint8_t * data, uint8_t len);
+  // log the records, oldest first
+  void dump(const char * tag);
+
+protected:
+  struct Record {
+    uint32_t time_;
+    uint16_t msg_id_;
+    Event event_;
+    uint8_t len_;
+    uint8_t data_[MAX_PACKET_LEN];
+  };
+
+  std::vector< Record > records_;
+  // free running counter, the index in records_ being modulo its size
+  size_t count_{0};
+};
 
 /**
   BleAdvEncoder: 
     Base class for encoders, for registration in the BleAdvHandler
-    and usage by BleAdvController
+    and usage by BleAdvController. The packet layout (BLE parameters and header) is given by BleAdvStaticEncoder.
  */
 class BleAdvEncoder {
 public:
@@ -133,38 +328,112 @@ public:
   bool is_id(const std::string & encoding, const std::string & variant) const { return (encoding == this->encoding_) && (variant == this->variant_); }
   bool is_encoding(const std::string & encoding) const { return (encoding == this->encoding_); }
 
-  void set_ble_param(uint8_t ad_flag, uint8_t adv_data_type){ this->ad_flag_ = ad_flag; this->adv_data_type_ = adv_data_type; }
-  bool is_ble_param(uint8_t ad_flag, uint8_t adv_data_type) { return this->ad_flag_ == ad_flag && this->adv_data_type_ == adv_data_type; }
-  void set_header(const std::vector< uint8_t > && header) { this->header_ = header; }
+  virtual bool is_ble_param(uint8_t ad_flag, uint8_t adv_data_type) const { return false; }
+  // length of the adv data section of the packets of this encoder, 0 if not decoding
+  virtual size_t get_data_len() const { return 0; }
+  virtual bool is_header(const uint8_t * buf) const { return false; }
+
+  virtual Commands translate(const Command & cmd, const ControllerParam_t & cont) = 0;
+  virtual void encode(std::vector< BleAdvParam > & params, Command &cmd, ControllerParam_t & cont) = 0;
+  virtual bool decode(const BleAdvParam & packet, Command &cmd, ControllerParam_t & cont) { return false; }
+
+  // Supported commands, as a bitmask over CommandType computed once at registration
+  void init_capabilities();
+  uint64_t get_capabilities() const { return this->capabilities_; }
+  bool is_supported(const Command &cmd) const { 
+    return (cmd.main_cmd_ < MAX_COMMAND_TYPE) && ((this->capabilities_ >> cmd.main_cmd_) & 1); 
+  }
+
+  // minimum duration in ms a command of this encoder is reliably received, used by the adaptive duration of the controllers
+  void set_duration_floor(uint32_t duration_floor) { this->duration_floor_ = duration_floor; }
+  uint32_t get_duration_floor() const { return this->duration_floor_; }
 
-  virtual std::vector< Command > translate(const Command & cmd, const ControllerParam_t & cont) = 0;
-  virtual void encode(std::vector< BleAdvParam > & params, Command &cmd, ControllerParam_t & cont);
-  virtual bool is_supported(const Command &cmd) ;
-  virtual bool decode(const BleAdvParam & packet, Command &cmd, ControllerParam_t & cont);
+  // signature of buf for the benchmark, with a new key at each call as when encoding. False if the encoder is not signing
+  virtual bool benchmark_sign(uint8_t * buf, uint32_t loop) { return false; }
 
 protected:
+  // the encoding primitives are benchmarked by the handler
+  friend class BleAdvHandler;
+
   virtual bool decode(uint8_t* buf, Command &cmd, ControllerParam_t & cont) { return false; };
   virtual void encode(uint8_t* buf, Command &cmd, ControllerParam_t & cont) { };
 
   // utils for encoding
   void reverse_all(uint8_t* buf, uint8_t len);
   void whiten(uint8_t *buf, size_t len, uint8_t seed);
+  // CRC16 without input / output inversion: reflected with poly 0x8408, or MSB first with poly 0x1021
+  uint16_t crc16_8408(const uint8_t* buf, size_t len, uint16_t crc);
+  uint16_t crc16_1021(const uint8_t* buf, size_t len, uint16_t crc);
 
   // encoder identifiers
   std::string id_;
   std::string encoding_;
   std::string variant_;
 
-  // BLE parameters
-  uint8_t ad_flag_{0x00};
-  uint8_t adv_data_type_{ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE};
-
   // Common parameters
-  std::vector< uint8_t > header_;
   size_t len_{0};
+  uint64_t capabilities_{0};
+  uint32_t duration_floor_{100};
+};
+
+/**
+  BleAdvStaticEncoder:
+    Encoder with its BLE parameters and header fixed at compile time, as generated by python codegen.
+    The packet layout being constant, encode / decode directly call the functions of the encoding,
+    the virtual interface only being used by the handler and for the runtime switch of encoder.
+ */
+template< class Enc, uint8_t AD_FLAG, uint8_t DATA_TYPE, uint8_t... HEADER >
+class BleAdvStaticEncoder: public Enc
+{
+public:
+  using Enc::Enc;
+
+  static constexpr uint8_t HEADER_BYTES[] = { HEADER... };
+  static constexpr size_t HEADER_LEN = sizeof...(HEADER);
+  static_assert(HEADER_LEN > 0, "BleAdvStaticEncoder: empty header");
+
+  virtual bool is_ble_param(uint8_t ad_flag, uint8_t adv_data_type) const override { 
+    return (ad_flag == AD_FLAG) && (adv_data_type == DATA_TYPE); 
+  }
+  virtual size_t get_data_len() const override { return HEADER_LEN + this->len_; }
+  virtual bool is_header(const uint8_t * buf) const override { return std::equal(HEADER_BYTES, HEADER_BYTES + HEADER_LEN, buf); }
+
+  virtual void encode(std::vector< BleAdvParam > & params, Command &cmd, ControllerParam_t & cont) override {
+    Commands cmds;
+    if (cmd.main_cmd_ == CommandType::CUSTOM) {
+      cmds.emplace_back(cmd);
+    } else {
+      cmds = this->Enc::translate(cmd, cont);
+    }
+    for (auto & acmd: cmds) {
+      cont.tx_count_++;
+      params.emplace_back();
+      BleAdvParam & param = params.back();
+      param.init_with_ble_param(AD_FLAG, DATA_TYPE);
+      std::copy(HEADER_BYTES, HEADER_BYTES + HEADER_LEN, param.get_data_buf());
+      ESP_LOGD(this->id_.c_str(), "UUID: '0x%lX', index: %d, tx: %d, cmd: '0x%02X', args: [%d,%d,%d,%d]", 
+          cont.id_, cont.index_, cont.tx_count_, acmd.cmd_, acmd.args_[0], acmd.args_[1], acmd.args_[2], acmd.args_[3]);
+      this->Enc::encode(param.get_data_buf() + HEADER_LEN, acmd, cont);
+      param.set_data_len(HEADER_LEN + this->len_);
+    }
+  }
+
+  virtual bool decode(const BleAdvParam & param, Command &cmd, ControllerParam_t & cont) override {
+    const uint8_t * cbuf = param.get_const_data_buf();
+    if (param.get_data_len() != HEADER_LEN + this->len_) return false;
+    if (!std::equal(HEADER_BYTES, HEADER_BYTES + HEADER_LEN, cbuf)) return false;
+
+    // copy the data to be decoded, not to alter it for other decoders
+    uint8_t buf[MAX_PACKET_LEN]{0};
+    std::copy(cbuf + HEADER_LEN, cbuf + param.get_data_len(), buf);
+    return this->Enc::decode(buf, cmd, cont);
+  }
 };
 
 #define ENSURE_EQ(param1, param2, ...) if ((param1) != (param2)) { ESP_LOGD(this->id_.c_str(), __VA_ARGS__); return false; }
+// same with the packet appended in hex, only formatted on failure and if DEBUG logs are compiled
+#define ENSURE_EQ_HEX(param1, param2, buf, len, msg) if ((param1) != (param2)) { \
+    ESP_LOGD(this->id_.c_str(), msg " - %s", esphome::format_hex_pretty(buf, len).c_str()); return false; }
 
 /**
   BleAdvMultiEncoder:
@@ -175,24 +444,167 @@ class BleAdvMultiEncoder: public BleAdvEncoder
 public:
   BleAdvMultiEncoder(const std::string encoding): BleAdvEncoder(encoding, "All") {}
   virtual void encode(std::vector< BleAdvParam > & params, Command &cmd, ControllerParam_t & cont) override;
-  virtual bool is_supported(const Command &cmd) override;
-  void add_encoder(BleAdvEncoder * encoder) { this->encoders_.push_back(encoder); }
+  void add_encoder(BleAdvEncoder * encoder) { 
+    this->encoders_.push_back(encoder); 
+    this->capabilities_ |= encoder->get_capabilities();
+    // all the variants advertised: reliable for all of them
+    this->duration_floor_ = (this->encoders_.size() == 1) ? encoder->get_duration_floor() : std::max(this->duration_floor_, encoder->get_duration_floor());
+  }
 
   // Not used
-  virtual std::vector< Command > translate(const Command & cmd, const ControllerParam_t & cont) { return std::vector< Command >(); };
+  virtual Commands translate(const Command & cmd, const ControllerParam_t & cont) { return Commands(); };
   virtual bool decode(const BleAdvParam & packet, Command &cmd, ControllerParam_t & cont) override { return false; }
+  virtual size_t get_data_len() const override { return 0; }
 
 protected:
   std::vector< BleAdvEncoder * > encoders_;
 };
 
+/**
+  Scheduling policy of the Advertiser, to choose the next packet to be advertised:
+    - ROUND_ROBIN: each packet in turn, whatever the controller
+    - WEIGHTED_FAIR: airtime shared in between controllers as per their weight, whatever their number of packets
+    - PRIORITY: highest priority class first, weighted fair in between packets of the same class.
+      A packet passed over MAX_WAITS times is served as top priority, bounding the latency of low classes.
+      Once advertised, a packet kept on air competes in the lowest class
+ */
+enum SchedulerPolicy {
+  ROUND_ROBIN = 0,
+  WEIGHTED_FAIR = 1,
+  PRIORITY = 2,
+};
+
+/**
+  BleAdvHistogram: latencies in ms counted in fixed buckets, to get percentiles over a window at no cost
+ */
+class BleAdvHistogram
+{
+public:
+  static constexpr size_t NB_BUCKETS = 12;
+
+  void add(uint32_t value);
+  // upper bound of the bucket reaching the percentile, bounded by the max value
+  uint32_t get_percentile(uint8_t percent) const;
+  uint32_t get_max() const { return this->max_; }
+  uint32_t get_count() const { return this->count_; }
+  void reset();
+
+protected:
+  static constexpr uint32_t BOUNDS[NB_BUCKETS] = {10, 20, 50, 100, 150, 200, 300, 500, 1000, 2000, 5000, UINT32_MAX};
+  uint32_t counts_[NB_BUCKETS]{0};
+  uint32_t count_{0};
+  uint32_t max_{0};
+};
+
+/**
+  BleAdvFlow: scheduling state of a controller for the Advertiser
+ */
+struct BleAdvFlow {
+  uint8_t weight_{1};
+  // virtual time: airtime consumed divided by weight
+  uint32_t vtime_{0};
+  // latency from request to first advertising of the commands
+  BleAdvHistogram latency_;
+};
+
+// Maximum number of packets advertised at the same time, when supported
+static constexpr uint8_t MAX_ADV_SETS = 4;
+
+/**
+  BleAdvGap:
+    Thin shim over the GAP advertising API and a one-shot timer per advertising set used by the Advertiser.
+    The GAP completion events and timer expiry are translated into calls to the BleAdvHandler 
+    'on_xxx' functions, allowing the Advertiser to be driven by any event source.
+ */
+class BleAdvHandler;
+class BleAdvGap
+{
+public:
+  virtual void init(BleAdvHandler * handler, esp_ble_adv_params_t * params) = 0;
+  virtual uint8_t get_nb_sets() const { return 1; }
+  virtual esp_err_t config_adv_data_raw(uint8_t set, uint8_t * buf, size_t len) = 0;
+  virtual esp_err_t start_advertising(uint8_t set) = 0;
+  virtual esp_err_t stop_advertising(uint8_t set) = 0;
+  virtual void start_timer(uint8_t set, uint32_t duration_ms) = 0;
+  virtual void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) = 0;
+};
+
+/**
+  BleAdvEspGap:
+    Base of the ESP-IDF implementations of the shim, the timers being esp_timer dispatched in the timer task
+ */
+class BleAdvEspGap: public BleAdvGap
+{
+public:
+  void init(BleAdvHandler * handler, esp_ble_adv_params_t * params) override;
+  void start_timer(uint8_t set, uint32_t duration_ms) override;
+
+protected:
+  struct TimerArg {
+    BleAdvHandler * handler_;
+    uint8_t set_;
+  };
+  BleAdvHandler * handler_{nullptr};
+  esp_timer_handle_t timers_[MAX_ADV_SETS]{nullptr};
+  TimerArg timer_args_[MAX_ADV_SETS];
+};
+
+#ifdef CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+/**
+  BleAdvEspExtGap:
+    BLE 5 extended advertising, legacy PDUs advertised on several sets at the same time.
+    The completion events are not providing the set in all IDF versions, but the requests
+    are processed in order: the sets are recorded per request type and matched in order.
+    The sets used are the first ones whose parameters were accepted by the controller.
+ */
+class BleAdvEspExtGap: public BleAdvEspGap
+{
+public:
+  void init(BleAdvHandler * handler, esp_ble_adv_params_t * params) override;
+  uint8_t get_nb_sets() const override { return this->nb_sets_; }
+  esp_err_t config_adv_data_raw(uint8_t set, uint8_t * buf, size_t len) override;
+  esp_err_t start_advertising(uint8_t set) override;
+  esp_err_t stop_advertising(uint8_t set) override;
+  void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) override;
+
+protected:
+  enum PendingOp { OP_PARAMS = 0, OP_DATA = 1, OP_START = 2, OP_STOP = 3, NB_OPS = 4 };
+  void push_pending(PendingOp op, uint8_t set);
+  bool pop_pending(PendingOp op, uint8_t & set);
+
+  uint8_t nb_sets_{0};
+  uint8_t pending_[NB_OPS][MAX_ADV_SETS]{};
+  uint8_t pending_start_[NB_OPS]{0};
+  uint8_t pending_count_[NB_OPS]{0};
+};
+using BleAdvDefaultGap = BleAdvEspExtGap;
+#else
+/**
+  BleAdvEspLegacyGap:
+    BLE 4.2 legacy advertising, only one packet advertised at a time
+ */
+class BleAdvEspLegacyGap: public BleAdvEspGap
+{
+public:
+  void init(BleAdvHandler * handler, esp_ble_adv_params_t * params) override;
+  esp_err_t config_adv_data_raw(uint8_t set, uint8_t * buf, size_t len) override { return esp_ble_gap_config_adv_data_raw(buf, len); }
+  esp_err_t start_advertising(uint8_t set) override { return esp_ble_gap_start_advertising(this->params_); }
+  esp_err_t stop_advertising(uint8_t set) override { return esp_ble_gap_stop_advertising(); }
+  void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) override;
+
+protected:
+  esp_ble_adv_params_t * params_{nullptr};
+};
+using BleAdvDefaultGap = BleAdvEspLegacyGap;
+#endif
+
 /**
   BleAdvHandler: Central class instanciated only ONCE
   It owns the list of registered encoders and their simplified access, to be used by Controllers.
   It owns the centralized Advertiser allowing to advertise multiple messages at the same time 
     with handling of prioritization and parallel send when possible
  */
-class BleAdvHandler: public Component
+class BleAdvHandler: public Component, public esp32_ble::GAPEventHandler
 #ifdef USE_API
   , public api::CustomAPIDevice
 #endif
@@ -201,24 +613,70 @@ public:
   // component handling
   void setup() override;
   void loop() override;
+  float get_setup_priority() const override { return setup_priority::AFTER_BLUETOOTH; }
 
   // Encoder registration and access
+  // Encoders and encodings are interned at registration as small handles, their index in the registry
+  static constexpr uint8_t NO_HANDLE = 0xFF;
   void add_encoder(BleAdvEncoder * encoder);
   BleAdvEncoder * get_encoder(const std::string & id);
   BleAdvEncoder * get_encoder(const std::string & encoding, const std::string & variant);
-  std::vector<std::string> get_ids(const std::string & encoding);
+  BleAdvEncoder * get_encoder(uint8_t handle) const { return (handle < this->encoders_.size()) ? this->encoders_[handle] : nullptr; }
+  uint8_t get_encoding_handle(const std::string & encoding) const;
+  // handles of the encoders of an encoding, its 'All' encoder first
+  const std::vector< uint8_t > & get_handles(uint8_t encoding_handle) const;
 
   // Advertiser
-  uint16_t add_to_advertiser(std::vector< BleAdvParam > & params);
+  void set_gap(BleAdvGap * gap) { this->gap_ = gap; }
+  void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) override;
+  void on_config_complete(uint8_t set, bool success);
+  void on_start_complete(uint8_t set, bool success);
+  void on_stop_complete(uint8_t set, bool success);
+  void on_adv_timer(uint8_t set);
+  void reserve_queue(size_t nb_packets) { this->queue_capacity_ += nb_packets; }
+  void set_scheduler(SchedulerPolicy policy) { this->policy_ = policy; }
+  uint8_t register_flow(uint8_t weight);
+  bool has_room(size_t nb_packets) const { return this->packets_.size() + nb_packets <= this->packets_.capacity(); }
+  uint16_t add_to_advertiser(std::vector< BleAdvParam > & params, uint8_t flow = 0, uint8_t priority = 0);
   void remove_from_advertiser(uint16_t msg_id);
+  // remove a message and add the next one at once, for the Advertiser to switch without waiting for another loop
+  // returns 0 with the params kept if no room for the next one yet, to be added later
+  uint16_t replace_in_advertiser(uint16_t msg_id, std::vector< BleAdvParam > & params, uint8_t flow = 0, uint8_t priority = 0);
+  // the message was advertised at least once, or is not in the Advertiser anymore
+  bool is_advertised(uint16_t msg_id);
+  uint32_t get_nb_config_skipped() const { return this->nb_config_skipped_; }
+
+  // Metrics: counters since boot, airtime in ms cumulated over all sets
+  uint8_t get_nb_sets() const { return this->nb_sets_; }
+  uint32_t get_nb_advertised() const { return this->nb_advertised_; }
+  uint32_t get_nb_dropped() const { return this->nb_dropped_; }
+  uint32_t get_airtime(uint32_t now) const;
+  BleAdvHistogram * get_latency(uint8_t flow) { return (flow < this->flows_.size()) ? &this->flows_[flow].latency_ : nullptr; }
+  uint32_t get_capture_decoded() const { return this->capture_decoded_; }
+  uint32_t get_capture_rejected() const { return this->capture_rejected_; }
 
   // identify which encoder is relevant for the param, decode and log Action and Controller parameters
   bool identify_param(const BleAdvParam & param, bool ignore_ble_param);
 
+  // measure the time and heap allocations per call of the encoding primitives and of the translate / encode / decode
+  // of each encoder, logged as JSON. The allocations are only counted with a counter of the allocations done so far.
+  void benchmark_encoders(uint32_t nb_loops = 1000);
+  void set_alloc_counter(uint32_t (*counter)()) { this->alloc_counter_ = counter; }
+  // encode / decode / re-encode nb_loops random commands of each type supported by each encoder, returns the number of failures
+  uint32_t check_encoders(uint32_t nb_loops = 10);
+
   // Listener
 #ifdef USE_ESP32_BLE_CLIENT
   void capture(const esp32_ble_tracker::ESPBTDevice & device, bool ignore_ble_param = true, uint16_t rem_time = 60);
 #endif
+  void set_capture_capacity(size_t capacity) { this->capture_capacity_ = capacity; }
+  void set_capture_queue_size(size_t size) { this->capture_queue_size_ = size; }
+
+  // Trace of the last advertising events, 0 to disable. Capacity to be set before the first event
+  void set_trace_capacity(size_t capacity) { this->trace_capacity_ = capacity; }
+  void dump_trace();
+  uint32_t get_capture_dropped() const { return this->capture_dropped_; }
+  size_t get_capture_queue_max() const { return this->capture_queue_max_; }
 
 #ifdef USE_API
   // HA service to decode
@@ -226,13 +684,71 @@ public:
 #endif
 
 protected:
-  // ref to registered encoders
+  bool check_reencode(BleAdvEncoder * encoder, const BleAdvParam & param, Command cmd, ControllerParam_t cont);
+
+  // ref to registered encoders, indexed by handle, and their encodings
   std::vector< BleAdvEncoder * > encoders_;
+  std::vector< std::string > encodings_;
+  std::vector< std::vector< uint8_t > > encoding_handles_;
+
+  // decoding encoders sorted by adv data length: the ones for a length are in [decoders_start_[len], decoders_start_[len + 1])
+  std::vector< BleAdvEncoder * > decoders_;
+  uint8_t decoders_start_[MAX_PACKET_LEN + 1]{0};
+
+  // Advertiser state machine per advertising set, driven by GAP completion events and the one-shot timers
+  enum class AdvState: uint8_t { IDLE, CONFIGURING, STARTING, ADVERTISING, EXPIRED, STOPPING };
+  struct BleAdvSet {
+    std::atomic< AdvState > state_{AdvState::IDLE};
+    // a switch to another packet / a removal is requested at the expiry of the window
+    bool switch_pending_{false};
+    uint8_t slot_{BleAdvQueue::NO_SLOT};
+    // payload currently configured on the set
+    uint8_t configured_buf_[MAX_PACKET_LEN]{0};
+    uint8_t configured_len_{0};
+    // start of the advertising, for airtime metric
+    bool on_air_{false};
+    uint32_t on_air_since_{0};
+    bool is_configured(BleAdvParam & param) {
+      return (this->configured_len_ != 0) && (this->configured_len_ == param.get_full_len())
+          && std::equal(this->configured_buf_, this->configured_buf_ + this->configured_len_, param.get_full_buf());
+    }
+  };
+  void set_state(BleAdvSet & set, AdvState state);
+  bool cas_state(BleAdvSet & set, AdvState expected, AdvState state) { return set.state_.compare_exchange_strong(expected, state); }
+  void advertise_next(uint8_t set);
+  void start_set(uint8_t set);
+  void advertise_waiting();
+  void release_slot(uint8_t index);
+  void release(uint8_t set);
+  uint8_t schedule();
+  bool is_before(BleAdvProcess & slot, BleAdvProcess & ref);
+  void merge_same_payload(uint8_t set);
+  void update_switch_pending();
+  bool request_stop(uint8_t set, AdvState from);
+
+  BleAdvDefaultGap esp_gap_;
+  BleAdvGap * gap_{&esp_gap_};
+  BleAdvSet sets_[MAX_ADV_SETS];
+  // sets usable, none until the GAP is initialized on the BLE stack enabled
+  bool gap_init_{false};
+  uint8_t nb_sets_{0};
+  size_t nb_on_air_{0};
+  uint32_t nb_config_skipped_{0};
+  uint32_t nb_advertised_{0};
+  uint32_t nb_dropped_{0};
+  uint32_t airtime_{0};
+  HighFrequencyLoopRequester high_freq_;
+
+  // scheduling
+  static constexpr uint8_t MAX_WAITS = 8;
+  static constexpr uint32_t VTIME_SCALE = 16;
+  SchedulerPolicy policy_{SchedulerPolicy::ROUND_ROBIN};
+  std::vector< BleAdvFlow > flows_;
+  uint32_t vclock_{0};
 
   // packets being advertised
-  std::list< BleAdvProcess > packets_;
-  uint16_t id_count = 1;
-  uint32_t adv_stop_time_ = 0;
+  size_t queue_capacity_{0};
+  BleAdvQueue packets_;
 
   esp_ble_adv_params_t adv_params_ = {
     .adv_int_min = 0x20,
@@ -246,7 +762,25 @@ protected:
   };
 
   // Packets already captured once
-  std::list< BleAdvParam > listen_packets_;
+  size_t capture_capacity_{64};
+  BleAdvCaptureCache captured_;
+
+  // Captured packets waiting to be decoded in the loop, within a time budget
+  static constexpr uint32_t CAPTURE_BUDGET_US = 5000;
+  size_t capture_queue_size_{16};
+  BleAdvCaptureQueue capture_queue_;
+  uint32_t capture_dropped_{0};
+  uint32_t capture_dropped_logged_{0};
+  size_t capture_queue_max_{0};
+  uint32_t capture_decoded_{0};
+  uint32_t capture_rejected_{0};
+  void decode_captured();
+
+  uint32_t (*alloc_counter_)(){nullptr};
+
+  BleAdvTrace trace_;
+  size_t trace_capacity_{32};
+  void trace(BleAdvTrace::Event event, uint16_t msg_id, const uint8_t * data = nullptr, uint8_t len = 0);
 };
 
 } //namespace bleadvcontroller
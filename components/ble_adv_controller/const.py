@@ -31,3 +31,23 @@ CONF_BLE_ADV_MAX_DURATION = "max_duration"
 CONF_BLE_ADV_SEQ_DURATION = "seq_duration"
 CONF_BLE_ADV_SPLIT_DIM_CCT = "separate_dim_cct"
 CONF_BLE_ADV_FORCED_REFRESH_ON_START = "forced_refresh_on_start"
+CONF_BLE_ADV_SCHEDULER = "scheduler"
+CONF_BLE_ADV_PRIORITY = "priority"
+CONF_BLE_ADV_WEIGHT = "weight"
+CONF_BLE_ADV_ALL_ENCODERS = "all_encoders"
+CONF_BLE_ADV_SIGN_ENGINE = "sign_engine"
+CONF_BLE_ADV_TRANSITION_STREAMING = "transition_streaming"
+CONF_BLE_ADV_ADAPTIVE_DURATION = "adaptive_duration"
+CONF_BLE_ADV_DURATION_FLOOR = "duration_floor"
+CONF_BLE_ADV_ADAPTIVE_BACKLOG = "adaptive_backlog"
+CONF_BLE_ADV_QUEUE_DEPTH = "queue_depth"
+CONF_BLE_ADV_COMMANDS_COALESCED = "commands_coalesced"
+CONF_BLE_ADV_COMMANDS_DROPPED = "commands_dropped"
+CONF_BLE_ADV_LATENCY_P50 = "latency_p50"
+CONF_BLE_ADV_LATENCY_P95 = "latency_p95"
+CONF_BLE_ADV_LATENCY_MAX = "latency_max"
+CONF_BLE_ADV_PACKETS_ADVERTISED = "packets_advertised"
+CONF_BLE_ADV_PACKETS_DROPPED = "packets_dropped"
+CONF_BLE_ADV_AIRTIME = "airtime"
+CONF_BLE_ADV_CAPTURE_DECODED = "capture_decoded"
+CONF_BLE_ADV_CAPTURE_REJECTED = "capture_rejected"
@@ -2,13 +2,10 @@
 #include "esphome/core/log.h"
 #include <arpa/inet.h>
 
-#define MBEDTLS_AES_ALT
-#include <aes_alt.h>
-
 namespace esphome {
 namespace bleadvcontroller {
 
-std::vector< Command > FanLampEncoder::translate(const Command & cmd, const ControllerParam_t & cont) {
+Commands FanLampEncoder::translate(const Command & cmd, const ControllerParam_t & cont) {
   Command cmd_real(cmd.main_cmd_);
   switch(cmd.main_cmd_)
   {
@@ -46,7 +43,7 @@ std::vector< Command > FanLampEncoder::translate(const Command & cmd, const Cont
     default:
       break;
   }
-  std::vector< Command > cmds;
+  Commands cmds;
   if(cmd_real.cmd_ != 0x00) {
     cmds.emplace_back(cmd_real);
   }
@@ -58,7 +55,7 @@ uint16_t FanLampEncoder::get_seed(uint16_t forced_seed) {
 }
 
 uint16_t FanLampEncoder::crc16(uint8_t* buf, size_t len, uint16_t seed) {
-  return esphome::crc16be(buf, len, seed);
+  return this->crc16_1021(buf, len, seed);
 }
 
 FanLampEncoderV1::FanLampEncoderV1(const std::string & encoding, const std::string & variant, uint8_t pair_arg3,
@@ -69,7 +66,7 @@ FanLampEncoderV1::FanLampEncoderV1(const std::string & encoding, const std::stri
   this->len_ = this->prefix_.size() + sizeof(data_map_t) + (this->with_crc2_ ? 2 : 1);
 }
 
-std::vector< Command > FanLampEncoderV1::translate(const Command & cmd, const ControllerParam_t & cont) {
+Commands FanLampEncoderV1::translate(const Command & cmd, const ControllerParam_t & cont) {
   auto cmds = FanLampEncoder::translate(cmd, cont);
   for (auto & cmd_real: cmds) {
     switch(cmd_real.main_cmd_)
@@ -115,23 +112,22 @@ bool FanLampEncoderV1::decode(uint8_t* buf, Command &cmd, ControllerParam_t & co
   if (data->command != 0x28 && !this->pair_arg_only_on_pair_ && data->args[2] != this->pair_arg3_) return false;
   if (data->command != 0x28 && this->pair_arg_only_on_pair_ && data->args[2] != 0) return false;
 
-  std::string decoded = esphome::format_hex_pretty(buf, this->len_);
   uint16_t seed = htons(data->seed);
   uint8_t seed8 = static_cast<uint8_t>(seed & 0xFF);
-  ENSURE_EQ(data->r2, this->xor1_ ? seed8 ^ 1 : seed8, "Decoded KO (r2) - %s", decoded.c_str());
+  ENSURE_EQ_HEX(data->r2, this->xor1_ ? seed8 ^ 1 : seed8, buf, this->len_, "Decoded KO (r2)");
 
   uint16_t crc16 = htons(this->crc16((uint8_t*)(data), sizeof(data_map_t) - 2, ~seed));
-  ENSURE_EQ(crc16, data->crc16, "Decoded KO (crc16) - %s", decoded.c_str());
+  ENSURE_EQ_HEX(crc16, data->crc16, buf, this->len_, "Decoded KO (crc16)");
 
   if (data->args[2] != 0) {
-    ENSURE_EQ(data->args[2], this->pair_arg3_, "Decoded KO (arg3) - %s", decoded.c_str());
+    ENSURE_EQ_HEX(data->args[2], this->pair_arg3_, buf, this->len_, "Decoded KO (arg3)");
   }
 
   if (this->with_crc2_) {
     uint16_t crc16_mac = this->crc16(buf + 1, 5, 0xffff);
     uint16_t crc16_2 = htons(this->crc16(buf + data_start, sizeof(data_map_t), crc16_mac));
     uint16_t crc16_data_2 = *(uint16_t*) &buf[this->len_ - 2];
-    ENSURE_EQ(crc16_data_2, crc16_2, "Decoded KO (crc16_2) - %s", decoded.c_str());
+    ENSURE_EQ_HEX(crc16_data_2, crc16_2, buf, this->len_, "Decoded KO (crc16_2)");
   }
 
   uint8_t rem_id = data->src ^ seed8;
@@ -200,23 +196,34 @@ void FanLampEncoderV1::encode(uint8_t* buf, Command &cmd_real, ControllerParam_t
 FanLampEncoderV2::FanLampEncoderV2(const std::string & encoding, const std::string & variant, const std::vector<uint8_t> && prefix, uint16_t device_type, bool with_sign):
   FanLampEncoder(encoding, variant, prefix), device_type_(device_type), with_sign_(with_sign) {
   this->len_ = this->prefix_.size() + sizeof(data_map_t);
+  this->sign_engine_ = new ScheduleSignEngine();
+}
+
+void FanLampEncoderV2::set_sign_engine(SignEngine * sign_engine) {
+  delete this->sign_engine_;
+  this->sign_engine_ = sign_engine;
+  this->sign_set_ = false;
 }
 
 uint16_t FanLampEncoderV2::sign(uint8_t* buf, uint8_t tx_count, uint16_t seed) {
-  uint8_t sigkey[16] = {0, 0, 0, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16};
-  
-  sigkey[0] = seed & 0xff;
-  sigkey[1] = (seed >> 8) & 0xff;
-  sigkey[2] = tx_count;
-  mbedtls_aes_context aes_ctx;
-  mbedtls_aes_init(&aes_ctx);
-  mbedtls_aes_setkey_enc(&aes_ctx, sigkey, sizeof(sigkey)*8);
-  uint8_t aes_in[16], aes_out[16];
-  memcpy(aes_in, buf, 16);
-  mbedtls_aes_crypt_ecb(&aes_ctx, ESP_AES_ENCRYPT, aes_in, aes_out);
-  mbedtls_aes_free(&aes_ctx);
+  if (this->sign_set_ && (this->sign_seed_ == seed) && (this->sign_tx_count_ == tx_count)
+      && std::equal(buf, buf + 16, this->sign_in_)) {
+    return this->sign_out_;
+  }
+  uint8_t aes_out[16];
+  memcpy(this->sign_in_, buf, 16);
+  this->sign_engine_->encrypt(this->sign_in_, aes_out, seed, tx_count);
+  this->sign_seed_ = seed;
+  this->sign_tx_count_ = tx_count;
+  this->sign_set_ = true;
   uint16_t sign = ((uint16_t*) aes_out)[0]; 
-  return sign == 0 ? 0xffff : sign;
+  this->sign_out_ = (sign == 0) ? 0xffff : sign;
+  return this->sign_out_;
+}
+
+bool FanLampEncoderV2::benchmark_sign(uint8_t * buf, uint32_t loop) {
+  this->sign(buf, loop & 0x7F, loop >> 7);
+  return this->with_sign_;
 }
 
 void FanLampEncoderV2::whiten(uint8_t *buf, uint8_t size, uint8_t seed, uint8_t salt) {
@@ -245,7 +252,7 @@ void FanLampEncoderV2::whiten(uint8_t *buf, uint8_t size, uint8_t seed, uint8_t
   }
 }
 
-std::vector< Command > FanLampEncoderV2::translate(const Command & cmd, const ControllerParam_t & cont) {
+Commands FanLampEncoderV2::translate(const Command & cmd, const ControllerParam_t & cont) {
   auto cmds = FanLampEncoder::translate(cmd, cont);
   for (auto & cmd_real: cmds) {
     switch(cmd_real.main_cmd_)
@@ -282,11 +289,10 @@ bool FanLampEncoderV2::decode(uint8_t* buf, Command &cmd, ControllerParam_t & co
   if (this->with_sign_ && data->sign == 0x0000) return false;
   if (!this->with_sign_ && data->sign != 0x0000) return false;
 
-  std::string decoded = esphome::format_hex_pretty(buf, this->len_);
-  ENSURE_EQ(crc16, data->crc16, "Decoded KO (crc16) - %s", decoded.c_str());
+  ENSURE_EQ_HEX(crc16, data->crc16, buf, this->len_, "Decoded KO (crc16)");
 
   if (this->with_sign_) {
-    ENSURE_EQ(this->sign(buf + 1, data->tx_count, data->seed), data->sign, "Decoded KO (sign) - %s", decoded.c_str());
+    ENSURE_EQ_HEX(this->sign(buf + 1, data->tx_count, data->seed), data->sign, buf, this->len_, "Decoded KO (sign)");
   }
 
   cmd.cmd_ = (CommandType) (data->command);
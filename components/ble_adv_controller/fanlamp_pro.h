@@ -2,6 +2,8 @@
 
 #include "ble_adv_controller.h"
 
+#include "sign_engine.h"
+
 namespace esphome {
 namespace bleadvcontroller {
 
@@ -12,7 +14,7 @@ public:
          BleAdvEncoder(encoding, variant), prefix_(prefix) {}
 
 protected:
-  virtual std::vector< Command > translate(const Command & cmd, const ControllerParam_t & cont) override;
+  virtual Commands translate(const Command & cmd, const ControllerParam_t & cont) override;
 
   uint16_t get_seed(uint16_t forced_seed = 0);
   uint16_t crc16(uint8_t* buf, size_t len, uint16_t seed);
@@ -39,7 +41,7 @@ protected:
     uint16_t crc16;
   }__attribute__((packed, aligned(1)));
 
-  virtual std::vector< Command > translate(const Command & cmd, const ControllerParam_t & cont) override;
+  virtual Commands translate(const Command & cmd, const ControllerParam_t & cont) override;
   virtual bool decode(uint8_t* buf, Command &cmd, ControllerParam_t & cont) override;
   virtual void encode(uint8_t* buf, Command &cmd, ControllerParam_t & cont) override;
 
@@ -53,6 +55,10 @@ class FanLampEncoderV2: public FanLampEncoder
 {
 public:
   FanLampEncoderV2(const std::string & encoding, const std::string & variant, const std::vector<uint8_t> && prefix, uint16_t device_type, bool with_sign);
+  virtual bool benchmark_sign(uint8_t * buf, uint32_t loop) override;
+  // the engine is owned by the encoder
+  void set_sign_engine(SignEngine * sign_engine);
+  SignEngine * get_sign_engine() { return this->sign_engine_; }
 
 protected:
   struct data_map_t {
@@ -68,7 +74,7 @@ protected:
     uint16_t crc16;
   }__attribute__((packed, aligned(1)));
 
-  virtual std::vector< Command > translate(const Command & cmd, const ControllerParam_t & cont) override;
+  virtual Commands translate(const Command & cmd, const ControllerParam_t & cont) override;
   virtual bool decode(uint8_t* buf, Command &cmd, ControllerParam_t & cont) override;
   virtual void encode(uint8_t* buf, Command &cmd, ControllerParam_t & cont) override;
 
@@ -77,6 +83,15 @@ protected:
 
   uint16_t device_type_;
   bool with_sign_;
+
+  // AES signing engine, the software AES with the key schedule kept over calls by default.
+  // The last signature is re used as decoding and re encoding a packet sign the same block.
+  SignEngine * sign_engine_{nullptr};
+  bool sign_set_{false};
+  uint16_t sign_seed_{0};
+  uint8_t sign_tx_count_{0};
+  uint8_t sign_in_[16]{0};
+  uint16_t sign_out_{0};
 };
 
 } //namespace bleadvcontroller
@@ -22,6 +22,7 @@ from .. import (
 from ..const import (
     CONF_BLE_ADV_SECONDARY,
     CONF_BLE_ADV_SPLIT_DIM_CCT,
+    CONF_BLE_ADV_TRANSITION_STREAMING,
 )
 
 BleAdvLight = bleadvcontroller_ns.class_('BleAdvLight', light.LightOutput, BleAdvEntity)
@@ -37,6 +38,7 @@ CONFIG_SCHEMA = cv.All(
                 cv.Optional(CONF_CONSTANT_BRIGHTNESS, default=False): cv.boolean,
                 cv.Optional(CONF_MIN_BRIGHTNESS, default="1%"): cv.percentage,
                 cv.Optional(CONF_BLE_ADV_SPLIT_DIM_CCT, default=False): cv.boolean,
+                cv.Optional(CONF_BLE_ADV_TRANSITION_STREAMING, default=False): cv.boolean,
                 # override default value of default_transition_length to 0s as mostly not supported by those lights
                 cv.Optional(CONF_DEFAULT_TRANSITION_LENGTH, default="0s"): cv.positive_time_period_milliseconds,
                 # override default value for restore mode, to always restore as it was if possible
@@ -66,4 +68,5 @@ async def to_code(config):
         cg.add(var.set_traits(config[CONF_COLD_WHITE_COLOR_TEMPERATURE], config[CONF_WARM_WHITE_COLOR_TEMPERATURE]))
         cg.add(var.set_constant_brightness(config[CONF_CONSTANT_BRIGHTNESS]))
         cg.add(var.set_split_dim_cct(config[CONF_BLE_ADV_SPLIT_DIM_CCT]))
+        cg.add(var.set_transition_streaming(config[CONF_BLE_ADV_TRANSITION_STREAMING]))
         cg.add(var.set_min_brightness(config[CONF_MIN_BRIGHTNESS] * 100, 0, 100, 1))
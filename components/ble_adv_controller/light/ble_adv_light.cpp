@@ -1,5 +1,6 @@
 #include "ble_adv_light.h"
 #include "esphome/core/log.h"
+#include "esphome/core/hal.h"
 
 namespace esphome {
 namespace bleadvcontroller {
@@ -37,6 +38,7 @@ void BleAdvLight::dump_config() {
   ESP_LOGCONFIG(TAG, "  Warm White Temperature: %f mireds", this->traits_.get_max_mireds());
   ESP_LOGCONFIG(TAG, "  Constant Brightness: %s", this->constant_brightness_ ? "true" : "false");
   ESP_LOGCONFIG(TAG, "  Minimum Brightness: %.0f%%", this->get_min_brightness() * 100);
+  ESP_LOGCONFIG(TAG, "  Transition Streaming: %s", this->transition_streaming_ ? "true" : "false");
 }
 
 void BleAdvLight::write_state(light::LightState *state) {
@@ -68,11 +70,22 @@ void BleAdvLight::write_state(light::LightState *state) {
   if ((br_diff < 3 && ct_diff < 3 && !is_last) || (is_last && br_diff == 0 && ct_diff == 0)) {
     return;
   }
+
+  // Transition streaming: an intermediate state is only sent if the controller can advertise it in time,
+  // else it is dropped, the next one or the final one being sent instead.
+  bool use_wcolor = this->get_parent()->is_supported(CommandType::LIGHT_WCOLOR) && !this->split_dim_cct_;
+  if (this->transition_streaming_ && !is_last) {
+    size_t nb_cmds = use_wcolor ? 1 : (ct_diff != 0) + (br_diff != 0);
+    if (!this->get_parent()->is_stream_ready(this->last_frame_time_, nb_cmds)) {
+      return;
+    }
+  }
+  this->last_frame_time_ = millis();
   
   this->brightness_ = updated_brf;
   this->warm_color_ = updated_ctf;
 
-  if(this->get_parent()->is_supported(CommandType::LIGHT_WCOLOR) && !this->split_dim_cct_) {
+  if(use_wcolor) {
     light::LightColorValues eff_values = state->current_values;
     eff_values.set_brightness(updated_brf);
     float cwf, wwf;
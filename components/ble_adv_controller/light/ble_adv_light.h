@@ -16,6 +16,7 @@ class BleAdvLight : public light::LightOutput, public BleAdvEntity, public Entit
   void set_constant_brightness(bool constant_brightness) { this->constant_brightness_ = constant_brightness; }
   void set_min_brightness(int min_brightness, int min, int max, int step);
   void set_split_dim_cct(bool split_dim_cct) { this->split_dim_cct_ = split_dim_cct; }
+  void set_transition_streaming(bool transition_streaming) { this->transition_streaming_ = transition_streaming; }
 
   float get_min_brightness() { return ((float)this->number_min_brightness_.state) / 100.0f; }
 
@@ -30,6 +31,8 @@ class BleAdvLight : public light::LightOutput, public BleAdvEntity, public Entit
   bool constant_brightness_;
   BleAdvNumber number_min_brightness_;
   bool split_dim_cct_;
+  bool transition_streaming_{false};
+  uint32_t last_frame_time_{0};
 
   bool is_off_{true};
   float brightness_{0};
@@ -0,0 +1,84 @@
+import esphome.codegen as cg
+import esphome.config_validation as cv
+from esphome.components import sensor
+
+from esphome.const import (
+    CONF_ID,
+    ENTITY_CATEGORY_DIAGNOSTIC,
+    STATE_CLASS_MEASUREMENT,
+    STATE_CLASS_TOTAL_INCREASING,
+    UNIT_MILLISECOND,
+    UNIT_PERCENT,
+)
+
+from .. import (
+    bleadvcontroller_ns,
+    BleAdvController,
+)
+
+from ..const import (
+    CONF_BLE_ADV_CONTROLLER_ID,
+    CONF_BLE_ADV_QUEUE_DEPTH,
+    CONF_BLE_ADV_COMMANDS_COALESCED,
+    CONF_BLE_ADV_COMMANDS_DROPPED,
+    CONF_BLE_ADV_LATENCY_P50,
+    CONF_BLE_ADV_LATENCY_P95,
+    CONF_BLE_ADV_LATENCY_MAX,
+    CONF_BLE_ADV_PACKETS_ADVERTISED,
+    CONF_BLE_ADV_PACKETS_DROPPED,
+    CONF_BLE_ADV_AIRTIME,
+    CONF_BLE_ADV_CAPTURE_DECODED,
+    CONF_BLE_ADV_CAPTURE_REJECTED,
+)
+
+BleAdvMetrics = bleadvcontroller_ns.class_('BleAdvMetrics', cg.PollingComponent)
+
+def counter_schema(icon):
+    return sensor.sensor_schema(
+        icon=icon,
+        accuracy_decimals=0,
+        state_class=STATE_CLASS_TOTAL_INCREASING,
+        entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+    )
+
+def measure_schema(icon, unit=cv.UNDEFINED, accuracy_decimals=0):
+    return sensor.sensor_schema(
+        icon=icon,
+        unit_of_measurement=unit,
+        accuracy_decimals=accuracy_decimals,
+        state_class=STATE_CLASS_MEASUREMENT,
+        entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+    )
+
+# sensor key => schema, the setter being 'set_<key>'
+BLE_ADV_METRICS = {
+    CONF_BLE_ADV_QUEUE_DEPTH: measure_schema("mdi:tray-full"),
+    CONF_BLE_ADV_COMMANDS_COALESCED: counter_schema("mdi:call-merge"),
+    CONF_BLE_ADV_COMMANDS_DROPPED: counter_schema("mdi:delete-empty"),
+    CONF_BLE_ADV_LATENCY_P50: measure_schema("mdi:timer-outline", UNIT_MILLISECOND),
+    CONF_BLE_ADV_LATENCY_P95: measure_schema("mdi:timer-outline", UNIT_MILLISECOND),
+    CONF_BLE_ADV_LATENCY_MAX: measure_schema("mdi:timer-alert-outline", UNIT_MILLISECOND),
+    CONF_BLE_ADV_PACKETS_ADVERTISED: counter_schema("mdi:bluetooth-transfer"),
+    CONF_BLE_ADV_PACKETS_DROPPED: counter_schema("mdi:bluetooth-off"),
+    CONF_BLE_ADV_AIRTIME: measure_schema("mdi:percent", UNIT_PERCENT, 1),
+    CONF_BLE_ADV_CAPTURE_DECODED: counter_schema("mdi:check-decagram"),
+    CONF_BLE_ADV_CAPTURE_REJECTED: counter_schema("mdi:close-octagon"),
+}
+
+CONFIG_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.declare_id(BleAdvMetrics),
+        cv.Required(CONF_BLE_ADV_CONTROLLER_ID): cv.use_id(BleAdvController),
+    }
+).extend(
+    { cv.Optional(key): schema for key, schema in BLE_ADV_METRICS.items() }
+).extend(cv.polling_component_schema("60s"))
+
+async def to_code(config):
+    var = cg.new_Pvariable(config[CONF_ID])
+    await cg.register_component(var, config)
+    await cg.register_parented(var, config[CONF_BLE_ADV_CONTROLLER_ID])
+    for key in BLE_ADV_METRICS:
+        if key in config:
+            sens = await sensor.new_sensor(config[key])
+            cg.add(getattr(var, f"set_{key}")(sens))
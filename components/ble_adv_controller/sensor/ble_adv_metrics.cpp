@@ -0,0 +1,82 @@
+#include "ble_adv_metrics.h"
+#include "esphome/core/log.h"
+#include "esphome/core/hal.h"
+
+namespace esphome {
+namespace bleadvcontroller {
+
+static const char *TAG = "ble_adv_metrics";
+
+void BleAdvMetrics::dump_config() {
+  ESP_LOGCONFIG(TAG, "BleAdvMetrics - controller '%s'", this->get_parent()->get_name().c_str());
+  LOG_SENSOR("  ", "Queue Depth", this->queue_depth_);
+  LOG_SENSOR("  ", "Commands Coalesced", this->commands_coalesced_);
+  LOG_SENSOR("  ", "Commands Dropped", this->commands_dropped_);
+  LOG_SENSOR("  ", "Latency p50", this->latency_p50_);
+  LOG_SENSOR("  ", "Latency p95", this->latency_p95_);
+  LOG_SENSOR("  ", "Latency Max", this->latency_max_);
+  LOG_SENSOR("  ", "Packets Advertised", this->packets_advertised_);
+  LOG_SENSOR("  ", "Packets Dropped", this->packets_dropped_);
+  LOG_SENSOR("  ", "Airtime", this->airtime_);
+  LOG_SENSOR("  ", "Capture Decoded", this->capture_decoded_);
+  LOG_SENSOR("  ", "Capture Rejected", this->capture_rejected_);
+}
+
+void BleAdvMetrics::update() {
+  BleAdvController * ctrl = this->get_parent();
+  BleAdvHandler * handler = ctrl->get_handler();
+
+  if (this->queue_depth_ != nullptr) {
+    this->queue_depth_->publish_state(ctrl->get_queue_depth());
+  }
+  if (this->commands_coalesced_ != nullptr) {
+    this->commands_coalesced_->publish_state(ctrl->get_nb_coalesced());
+  }
+  if (this->commands_dropped_ != nullptr) {
+    this->commands_dropped_->publish_state(ctrl->get_nb_dropped());
+  }
+
+  // latencies over the last update interval, no value if no command was sent
+  BleAdvHistogram * latency = handler->get_latency(ctrl->get_flow());
+  if (latency != nullptr) {
+    if (latency->get_count() > 0) {
+      if (this->latency_p50_ != nullptr) {
+        this->latency_p50_->publish_state(latency->get_percentile(50));
+      }
+      if (this->latency_p95_ != nullptr) {
+        this->latency_p95_->publish_state(latency->get_percentile(95));
+      }
+      if (this->latency_max_ != nullptr) {
+        this->latency_max_->publish_state(latency->get_max());
+      }
+    }
+    latency->reset();
+  }
+
+  if (this->packets_advertised_ != nullptr) {
+    this->packets_advertised_->publish_state(handler->get_nb_advertised());
+  }
+  if (this->packets_dropped_ != nullptr) {
+    this->packets_dropped_->publish_state(handler->get_nb_dropped());
+  }
+
+  // percentage of the available airtime (all sets) used since the last update
+  uint32_t now = millis();
+  uint32_t airtime = handler->get_airtime(now);
+  if ((this->airtime_ != nullptr) && (this->last_update_ != 0) && (now != this->last_update_) && (handler->get_nb_sets() > 0)) {
+    float available = (float)(now - this->last_update_) * handler->get_nb_sets();
+    this->airtime_->publish_state(100.0f * (airtime - this->last_airtime_) / available);
+  }
+  this->last_update_ = now;
+  this->last_airtime_ = airtime;
+
+  if (this->capture_decoded_ != nullptr) {
+    this->capture_decoded_->publish_state(handler->get_capture_decoded());
+  }
+  if (this->capture_rejected_ != nullptr) {
+    this->capture_rejected_->publish_state(handler->get_capture_rejected());
+  }
+}
+
+} // namespace bleadvcontroller
+} // namespace esphome
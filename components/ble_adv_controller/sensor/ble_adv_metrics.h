@@ -0,0 +1,53 @@
+#pragma once
+
+#include "esphome/core/component.h"
+#include "esphome/components/sensor/sensor.h"
+#include "../ble_adv_controller.h"
+
+namespace esphome {
+namespace bleadvcontroller {
+
+/**
+  BleAdvMetrics: publishes the runtime metrics of a controller and of the shared advertiser
+ */
+class BleAdvMetrics : public PollingComponent, public Parented < BleAdvController >
+{
+ public:
+  void dump_config() override;
+  void update() override;
+
+  // controller metrics
+  void set_queue_depth(sensor::Sensor * sensor) { this->queue_depth_ = sensor; }
+  void set_commands_coalesced(sensor::Sensor * sensor) { this->commands_coalesced_ = sensor; }
+  void set_commands_dropped(sensor::Sensor * sensor) { this->commands_dropped_ = sensor; }
+  void set_latency_p50(sensor::Sensor * sensor) { this->latency_p50_ = sensor; }
+  void set_latency_p95(sensor::Sensor * sensor) { this->latency_p95_ = sensor; }
+  void set_latency_max(sensor::Sensor * sensor) { this->latency_max_ = sensor; }
+
+  // advertiser metrics, shared by all controllers
+  void set_packets_advertised(sensor::Sensor * sensor) { this->packets_advertised_ = sensor; }
+  void set_packets_dropped(sensor::Sensor * sensor) { this->packets_dropped_ = sensor; }
+  void set_airtime(sensor::Sensor * sensor) { this->airtime_ = sensor; }
+  void set_capture_decoded(sensor::Sensor * sensor) { this->capture_decoded_ = sensor; }
+  void set_capture_rejected(sensor::Sensor * sensor) { this->capture_rejected_ = sensor; }
+
+ protected:
+  sensor::Sensor * queue_depth_{nullptr};
+  sensor::Sensor * commands_coalesced_{nullptr};
+  sensor::Sensor * commands_dropped_{nullptr};
+  sensor::Sensor * latency_p50_{nullptr};
+  sensor::Sensor * latency_p95_{nullptr};
+  sensor::Sensor * latency_max_{nullptr};
+  sensor::Sensor * packets_advertised_{nullptr};
+  sensor::Sensor * packets_dropped_{nullptr};
+  sensor::Sensor * airtime_{nullptr};
+  sensor::Sensor * capture_decoded_{nullptr};
+  sensor::Sensor * capture_rejected_{nullptr};
+
+  // airtime computed as a ratio over the update interval
+  uint32_t last_update_{0};
+  uint32_t last_airtime_{0};
+};
+
+} //namespace bleadvcontroller
+} //namespace esphome
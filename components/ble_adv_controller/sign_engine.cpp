@@ -0,0 +1,180 @@
+#include "sign_engine.h"
+
+#include <algorithm>
+
+namespace esphome {
+namespace bleadvcontroller {
+
+/*********************
+Table based AES-128 (FIPS-197), encryption only
+**********************/
+
+static constexpr uint8_t SBOX[256] = {
+  0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+  0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0, 0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+  0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+  0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+  0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0, 0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+  0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+  0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+  0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5, 0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+  0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+  0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+  0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C, 0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+  0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+  0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+  0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E, 0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+  0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+  0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16
+};
+
+static constexpr uint8_t xtime(uint8_t x) { return (uint8_t) ((x << 1) ^ ((x & 0x80) ? 0x1B : 0x00)); }
+
+// SubBytes and MixColumns of a byte in first row: S.{02, 01, 01, 03}, the other rows being rotations of it
+struct TeTable {
+  uint32_t te[256];
+};
+static constexpr TeTable make_te0() {
+  TeTable table{};
+  for (uint16_t i = 0; i < 256; ++i) {
+    uint8_t s = SBOX[i];
+    uint8_t s2 = xtime(s);
+    table.te[i] = ((uint32_t) s2 << 24) | ((uint32_t) s << 16) | ((uint32_t) s << 8) | (uint8_t) (s2 ^ s);
+  }
+  return table;
+}
+static constexpr TeTable TE0 = make_te0();
+
+static inline uint32_t ror(uint32_t x, uint8_t n) { return (x >> n) | (x << (32 - n)); }
+
+static inline uint32_t load_be(const uint8_t * buf) {
+  return ((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16) | ((uint32_t) buf[2] << 8) | buf[3];
+}
+
+static inline void store_be(uint8_t * buf, uint32_t x) {
+  buf[0] = x >> 24;
+  buf[1] = x >> 16;
+  buf[2] = x >> 8;
+  buf[3] = x;
+}
+
+// SubWord(RotWord(w)) ^ Rcon
+static inline uint32_t key_core(uint32_t w, uint8_t rcon) {
+  return (((uint32_t) (SBOX[(w >> 16) & 0xFF] ^ rcon)) << 24) | ((uint32_t) SBOX[(w >> 8) & 0xFF] << 16)
+      | ((uint32_t) SBOX[w & 0xFF] << 8) | SBOX[w >> 24];
+}
+
+// round keys from index 'from' (multiple of 4, rcon being the one of this round) to the end
+static void expand_from(uint32_t * rk, uint8_t from, uint8_t rcon) {
+  for (uint8_t i = from; i < 44; i += 4) {
+    rk[i] = rk[i - 4] ^ key_core(rk[i - 1], rcon);
+    rk[i + 1] = rk[i - 3] ^ rk[i];
+    rk[i + 2] = rk[i - 2] ^ rk[i + 1];
+    rk[i + 3] = rk[i - 1] ^ rk[i + 2];
+    rcon = xtime(rcon);
+  }
+}
+
+// first word of the key: the seed and tx count, then the first fixed byte
+static inline uint32_t key_word0(uint16_t seed, uint8_t tx_count) {
+  return ((uint32_t) (seed & 0xFF) << 24) | ((uint32_t) (seed >> 8) << 16) | ((uint32_t) tx_count << 8) | SignEngine::KEY_FIXED[0];
+}
+
+void SoftSignEngine::expand_key(const uint8_t * key, uint32_t * rk) {
+  for (uint8_t i = 0; i < 4; ++i) {
+    rk[i] = load_be(key + 4 * i);
+  }
+  expand_from(rk, 4, 0x01);
+}
+
+void SoftSignEngine::encrypt_block(const uint32_t * rk, const uint8_t * in, uint8_t * out) {
+  uint32_t s0 = load_be(in) ^ rk[0];
+  uint32_t s1 = load_be(in + 4) ^ rk[1];
+  uint32_t s2 = load_be(in + 8) ^ rk[2];
+  uint32_t s3 = load_be(in + 12) ^ rk[3];
+  for (uint8_t round = 1; round < 10; ++round) {
+    const uint32_t * k = rk + 4 * round;
+    uint32_t t0 = TE0.te[s0 >> 24] ^ ror(TE0.te[(s1 >> 16) & 0xFF], 8) ^ ror(TE0.te[(s2 >> 8) & 0xFF], 16) ^ ror(TE0.te[s3 & 0xFF], 24) ^ k[0];
+    uint32_t t1 = TE0.te[s1 >> 24] ^ ror(TE0.te[(s2 >> 16) & 0xFF], 8) ^ ror(TE0.te[(s3 >> 8) & 0xFF], 16) ^ ror(TE0.te[s0 & 0xFF], 24) ^ k[1];
+    uint32_t t2 = TE0.te[s2 >> 24] ^ ror(TE0.te[(s3 >> 16) & 0xFF], 8) ^ ror(TE0.te[(s0 >> 8) & 0xFF], 16) ^ ror(TE0.te[s1 & 0xFF], 24) ^ k[2];
+    uint32_t t3 = TE0.te[s3 >> 24] ^ ror(TE0.te[(s0 >> 16) & 0xFF], 8) ^ ror(TE0.te[(s1 >> 8) & 0xFF], 16) ^ ror(TE0.te[s2 & 0xFF], 24) ^ k[3];
+    s0 = t0;
+    s1 = t1;
+    s2 = t2;
+    s3 = t3;
+  }
+  // last round: no MixColumns
+  const uint32_t s[4] = {s0, s1, s2, s3};
+  for (uint8_t c = 0; c < 4; ++c) {
+    uint32_t t = ((uint32_t) SBOX[s[c] >> 24] << 24) | ((uint32_t) SBOX[(s[(c + 1) & 3] >> 16) & 0xFF] << 16)
+        | ((uint32_t) SBOX[(s[(c + 2) & 3] >> 8) & 0xFF] << 8) | SBOX[s[(c + 3) & 3] & 0xFF];
+    store_be(out + 4 * c, t ^ rk[40 + c]);
+  }
+}
+
+void SoftSignEngine::encrypt(const uint8_t * in, uint8_t * out, uint16_t seed, uint8_t tx_count) {
+  uint8_t key[KEY_LEN];
+  store_be(key, key_word0(seed, tx_count));
+  std::copy(KEY_FIXED + 1, KEY_FIXED + sizeof(KEY_FIXED), key + 4);
+  expand_key(key, this->rk_);
+  encrypt_block(this->rk_, in, out);
+}
+
+/*********************
+Key schedule kept over calls
+**********************/
+
+ScheduleSignEngine::ScheduleSignEngine() {
+  // words 1 to 3 only made of fixed bytes
+  for (uint8_t i = 1; i < 4; ++i) {
+    this->rk_[i] = load_be(KEY_FIXED + 4 * i - 3);
+  }
+  // second round key: w4 = w0 ^ core(w3), w5 = w1 ^ w4, ...
+  this->round1_[0] = key_core(this->rk_[3], 0x01);
+  for (uint8_t i = 1; i < 4; ++i) {
+    this->round1_[i] = this->round1_[i - 1] ^ this->rk_[i];
+  }
+}
+
+void ScheduleSignEngine::encrypt(const uint8_t * in, uint8_t * out, uint16_t seed, uint8_t tx_count) {
+  uint32_t word0 = key_word0(seed, tx_count);
+  if (!this->expanded_ || (word0 != this->word0_)) {
+    this->rk_[0] = word0;
+    for (uint8_t i = 0; i < 4; ++i) {
+      this->rk_[4 + i] = word0 ^ this->round1_[i];
+    }
+    expand_from(this->rk_, 8, 0x02);
+    this->word0_ = word0;
+    this->expanded_ = true;
+  }
+  encrypt_block(this->rk_, in, out);
+}
+
+/*********************
+ESP32 AES peripheral
+**********************/
+
+HwSignEngine::HwSignEngine() {
+  esp_aes_init(&this->aes_ctx_);
+  std::copy(KEY_FIXED, KEY_FIXED + sizeof(KEY_FIXED), this->key_ + 3);
+}
+
+HwSignEngine::~HwSignEngine() {
+  esp_aes_free(&this->aes_ctx_);
+}
+
+void HwSignEngine::encrypt(const uint8_t * in, uint8_t * out, uint16_t seed, uint8_t tx_count) {
+  // Only the 3 first bytes of the key are variable
+  bool same_key = this->key_set_ && (this->key_[0] == (seed & 0xff))
+      && (this->key_[1] == ((seed >> 8) & 0xff)) && (this->key_[2] == tx_count);
+  if (!same_key) {
+    this->key_[0] = seed & 0xff;
+    this->key_[1] = (seed >> 8) & 0xff;
+    this->key_[2] = tx_count;
+    this->key_set_ = (esp_aes_setkey(&this->aes_ctx_, this->key_, sizeof(this->key_)*8) == 0);
+  }
+  esp_aes_crypt_ecb(&this->aes_ctx_, ESP_AES_ENCRYPT, in, out);
+}
+
+} // namespace bleadvcontroller
+} // namespace esphome
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <aes/esp_aes.h>
+
+namespace esphome {
+namespace bleadvcontroller {
+
+/**
+  SignEngine: AES-128 encryption of one block with the key of the FanLamp signature,
+    whose 3 first bytes are the seed and tx count of the packet, the 13 others being fixed.
+    A new key is needed for almost each packet encoded or decoded. Backends:
+      - SoftSignEngine: portable table based AES, the key being fully expanded at each call
+      - ScheduleSignEngine: same AES, the key schedule of the fixed bytes kept over calls
+      - HwSignEngine: AES peripheral of the ESP32, through the esp_aes driver of ESP-IDF
+ */
+class SignEngine
+{
+public:
+  virtual ~SignEngine() = default;
+  virtual const char * get_name() const = 0;
+  virtual void encrypt(const uint8_t * in, uint8_t * out, uint16_t seed, uint8_t tx_count) = 0;
+
+  static constexpr uint8_t KEY_LEN = 16;
+  // the key bytes after the seed and tx count
+  static constexpr uint8_t KEY_FIXED[13] = {0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16};
+};
+
+class SoftSignEngine: public SignEngine
+{
+public:
+  virtual const char * get_name() const override { return "software"; }
+  virtual void encrypt(const uint8_t * in, uint8_t * out, uint16_t seed, uint8_t tx_count) override;
+
+protected:
+  // the round keys, as 44 big endian words
+  static void expand_key(const uint8_t * key, uint32_t * rk);
+  static void encrypt_block(const uint32_t * rk, const uint8_t * in, uint8_t * out);
+  uint32_t rk_[44];
+};
+
+/**
+  ScheduleSignEngine: the variable key bytes are all in the first word of the key schedule.
+    The words of the fixed bytes, and the ones of the second round key that only depend on them
+    (each one being the first word xor a constant), are computed once: a new key only patches
+    these 2 round keys, the 9 next ones being derived from them as they go through the S-box.
+    The round keys of the last key are kept, as decoding then re encoding a packet use the same.
+ */
+class ScheduleSignEngine: public SoftSignEngine
+{
+public:
+  ScheduleSignEngine();
+  virtual const char * get_name() const override { return "schedule"; }
+  virtual void encrypt(const uint8_t * in, uint8_t * out, uint16_t seed, uint8_t tx_count) override;
+
+protected:
+  // xor of the first word giving each word of the second round key
+  uint32_t round1_[4];
+  uint32_t word0_{0};
+  bool expanded_{false};
+};
+
+class HwSignEngine: public SignEngine
+{
+public:
+  HwSignEngine();
+  virtual ~HwSignEngine();
+  virtual const char * get_name() const override { return "hardware"; }
+  virtual void encrypt(const uint8_t * in, uint8_t * out, uint16_t seed, uint8_t tx_count) override;
+
+protected:
+  // the key is only set again when changed
+  esp_aes_context aes_ctx_;
+  uint8_t key_[KEY_LEN];
+  bool key_set_{false};
+};
+
+} //namespace bleadvcontroller
+} //namespace esphome
@@ -10,7 +10,8 @@ static constexpr size_t UID_LEN = 3;
 static uint8_t UID[UID_LEN] = {0x19, 0x01, 0x10};
 
 uint16_t ZhijiaEncoder::crc16(uint8_t* buf, size_t len, uint16_t seed) {
-  return esphome::crc16(buf, len, seed, 0x8408, true, true);
+  // reflected CRC, with input and output inversion
+  return ~this->crc16_8408(buf, len, ~seed);
 }
 
 // {0xAB, 0xCD, 0xEF} => 0xABCDEF
@@ -29,7 +30,7 @@ void ZhijiaEncoder::id_to_uuid(uint8_t * uuid, uint32_t id, size_t len) {
   }
 }
 
-std::vector< Command > ZhijiaEncoderV0::translate(const Command & cmd, const ControllerParam_t & cont) {
+Commands ZhijiaEncoderV0::translate(const Command & cmd, const ControllerParam_t & cont) {
   Command cmd_real(cmd.main_cmd_);
   switch(cmd.main_cmd_)
   {
@@ -76,7 +77,7 @@ std::vector< Command > ZhijiaEncoderV0::translate(const Command & cmd, const Con
     default:
       break;
   }
-  std::vector< Command > cmds;
+  Commands cmds;
   if(cmd_real.cmd_ != 0x00) {
     cmds.emplace_back(cmd_real);
   }
@@ -134,7 +135,7 @@ void ZhijiaEncoderV0::encode(uint8_t* buf, Command &cmd_real, ControllerParam_t
   this->whiten(buf, this->len_, 0x37);
 }
 
-std::vector< Command > ZhijiaEncoderV1::translate(const Command & cmd, const ControllerParam_t & cont) {
+Commands ZhijiaEncoderV1::translate(const Command & cmd, const ControllerParam_t & cont) {
   Command cmd_real(cmd.main_cmd_);
   switch(cmd.main_cmd_)
   {
@@ -174,7 +175,7 @@ std::vector< Command > ZhijiaEncoderV1::translate(const Command & cmd, const Con
     default:
       break;
   }
-  std::vector< Command > cmds;
+  Commands cmds;
   if(cmd_real.cmd_ != 0x00) {
     cmds.emplace_back(cmd_real);
   }
@@ -263,7 +264,7 @@ void ZhijiaEncoderV1::encode(uint8_t* buf, Command &cmd_real, ControllerParam_t
   this->whiten(buf, this->len_, 0x37);
 }
 
-std::vector< Command > ZhijiaEncoderV2::translate(const Command & cmd, const ControllerParam_t & cont) {
+Commands ZhijiaEncoderV2::translate(const Command & cmd, const ControllerParam_t & cont) {
   auto cmds = ZhijiaEncoderV1::translate(cmd, cont);
   if (!cmds.empty()) return cmds;
 
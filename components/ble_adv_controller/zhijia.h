@@ -32,7 +32,7 @@ protected:
     uint16_t crc16;
   }__attribute__((packed, aligned(1)));
 
-  virtual std::vector< Command > translate(const Command & cmd, const ControllerParam_t & cont) override;
+  virtual Commands translate(const Command & cmd, const ControllerParam_t & cont) override;
   virtual bool decode(uint8_t* buf, Command &cmd, ControllerParam_t & cont) override;
   virtual void encode(uint8_t* buf, Command &cmd, ControllerParam_t & cont) override;
 };
@@ -53,7 +53,7 @@ protected:
     uint16_t crc16;
   }__attribute__((packed, aligned(1)));
 
-  virtual std::vector< Command > translate(const Command & cmd, const ControllerParam_t & cont) override;
+  virtual Commands translate(const Command & cmd, const ControllerParam_t & cont) override;
   virtual bool decode(uint8_t* buf, Command &cmd, ControllerParam_t & cont) override;
   virtual void encode(uint8_t* buf, Command &cmd, ControllerParam_t & cont) override;
 };
@@ -75,7 +75,7 @@ protected:
     uint8_t spare[SPARE_LEN];
   }__attribute__((packed, aligned(1)));
 
-  virtual std::vector< Command > translate(const Command & cmd, const ControllerParam_t & cont) override;
+  virtual Commands translate(const Command & cmd, const ControllerParam_t & cont) override;
   virtual bool decode(uint8_t* buf, Command &cmd, ControllerParam_t & cont) override;
   virtual void encode(uint8_t* buf, Command &cmd, ControllerParam_t & cont) override;
 };
@@ -0,0 +1,19 @@
+import esphome.config_validation as cv
+from esphome.components.ble_adv_controller.const import (
+    CONF_BLE_ADV_ALL_ENCODERS,
+    CONF_BLE_ADV_SIGN_ENGINE,
+)
+
+# Options of the handler shared by all the controllers. The handler itself is generated
+# by 'ble_adv_controller' together with the first controller, reading this config.
+DEPENDENCIES = ["ble_adv_controller"]
+
+CONFIG_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_BLE_ADV_ALL_ENCODERS, default=False): cv.boolean,
+        cv.Optional(CONF_BLE_ADV_SIGN_ENGINE, default="schedule"): cv.one_of("schedule", "software", "hardware", lower=True),
+    }
+)
+
+async def to_code(config):
+    pass
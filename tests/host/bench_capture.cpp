@@ -0,0 +1,89 @@
+// Benchmark of the capture of the scanned advertisements on host, on the wall clock:
+//   bench_capture [nb_packets]
+// nb_packets adverts drawn from a pool of distinct payloads, 1 in 8 being a packet of an encoder, the others random.
+// The capture queue is decoded every 16 adverts as by the main loop. One JSON line per scenario, with the time per
+// advert of capture() (BLE tracker side) and of the decoding (main loop side) and the heap allocations per advert.
+
+#include "harness/alloc_counter.h"
+#include "harness/encoders.h"
+#include "harness/primitives.h"
+#include "harness/test.h"
+
+#include "esphome/components/esp32_ble_tracker/esp32_ble_tracker.h"
+
+#include <cstdlib>
+
+using namespace esphome::bleadvcontroller;
+using esphome::esp32_ble_tracker::ESPBTDevice;
+
+// access to the decoding of the captured packets, done in the main loop
+struct CaptureHandler: public BleAdvHandler {
+  using BleAdvHandler::decode_captured;
+};
+
+static void run(const char * name, uint32_t nb_packets, size_t nb_distinct, size_t capacity) {
+  CaptureHandler handler;
+  host::register_encoders(handler);
+  handler.set_capture_capacity(capacity);
+  srand(1);
+
+  std::vector< BleAdvEncoder * > encoders;
+  for (uint8_t handle = 0; BleAdvEncoder * encoder = handler.get_encoder(handle); ++handle) {
+    if (encoder->get_data_len() > 0) encoders.push_back(encoder);
+  }
+
+  // pool of distinct adverts, and the sequence of the received ones
+  std::vector< ESPBTDevice > pool(nb_distinct);
+  for (size_t i = 0; i < nb_distinct; ++i) {
+    uint8_t buf[MAX_PACKET_LEN] = {0x02, 0x01, 0x02, 0x1B, 0x03};
+    uint8_t len = sizeof(buf);
+    if (i % 8 == 0) {
+      BleAdvEncoder * encoder = encoders[rand() % encoders.size()];
+      Command cmd(CommandType::LIGHT_ON);
+      ControllerParam_t cont;
+      cont.id_ = rand() & 0xFFFF;
+      std::vector< BleAdvParam > params;
+      encoder->encode(params, cmd, cont);
+      len = params.back().get_full_len();
+      std::copy(params.back().get_full_buf(), params.back().get_full_buf() + len, buf);
+    } else {
+      for (size_t j = 5; j < sizeof(buf); ++j) buf[j] = rand() & 0xFF;
+    }
+    pool[i].set_raw(buf, len);
+  }
+  std::vector< uint16_t > sequence(nb_packets);
+  for (auto & index : sequence) index = rand() % nb_distinct;
+
+  static constexpr uint32_t BATCH = 16;
+  double capture_ns = 0;
+  double decode_ns = 0;
+  uint32_t capture_allocs = 0;
+  uint32_t decode_allocs = 0;
+  for (uint32_t i = 0; i < nb_packets; i += BATCH) {
+    uint32_t start_allocs = host::get_nb_allocs();
+    capture_ns += host::time_ns(1, [&](uint32_t) {
+      for (uint32_t j = i; (j < i + BATCH) && (j < nb_packets); ++j) handler.capture(pool[sequence[j]], true, 60);
+    });
+    capture_allocs += host::get_nb_allocs() - start_allocs;
+    start_allocs = host::get_nb_allocs();
+    decode_ns += host::time_ns(1, [&](uint32_t) { handler.decode_captured(); });
+    decode_allocs += host::get_nb_allocs() - start_allocs;
+  }
+
+  printf("{\"capture\":\"%s\",\"packets\":%d,\"distinct\":%d,\"capacity\":%d,\"capture_ns\":%.0f,\"decode_ns\":%.0f,"
+         "\"capture_allocs\":%.2f,\"decode_allocs\":%.2f,\"decoded\":%d,\"rejected\":%d,\"dropped\":%d}\n",
+         name, nb_packets, (int)nb_distinct, (int)capacity, capture_ns / nb_packets, decode_ns / nb_packets,
+         (float)capture_allocs / nb_packets, (float)decode_allocs / nb_packets,
+         handler.get_capture_decoded(), handler.get_capture_rejected(), handler.get_capture_dropped());
+  CHECK(handler.get_capture_decoded() + handler.get_capture_rejected() + handler.get_capture_dropped() > 0);
+}
+
+int main(int argc, char ** argv) {
+  uint32_t nb_packets = (argc > 1) ? atoi(argv[1]) : 100000;
+  esphome::host_log_level = ESPHOME_LOG_LEVEL_ERROR;
+  // the same devices advertising again and again, all kept in the cache
+  run("repeated", nb_packets, 32, 64);
+  // a busy environment: more distinct adverts than the cache capacity, the oldest ones being evicted
+  run("busy", nb_packets, 2000, 256);
+  return host::test_result("bench_capture");
+}
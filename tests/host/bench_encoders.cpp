@@ -0,0 +1,23 @@
+// Benchmark of the encoders on host, as ble_adv_static_handler->benchmark_encoders() on the device,
+// with the heap allocations counted by harness/alloc_counter.cpp:
+//   bench_encoders [nb_loops]
+// One JSON line per encoding primitive and per encoder, with the time and allocations per call.
+
+#include "harness/alloc_counter.h"
+#include "harness/encoders.h"
+#include "harness/sim.h"
+
+#include <cstdlib>
+
+using namespace esphome::bleadvcontroller;
+
+int main(int argc, char ** argv) {
+  uint32_t nb_loops = (argc > 1) ? atoi(argv[1]) : 10000;
+  esphome::host_log_level = ESPHOME_LOG_LEVEL_INFO;
+  host::Sim::get().wall_clock_ = true;
+  BleAdvHandler handler;
+  host::register_encoders(handler);
+  handler.set_alloc_counter(host::get_nb_allocs);
+  handler.benchmark_encoders(nb_loops);
+  return 0;
+}
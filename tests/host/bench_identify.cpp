@@ -0,0 +1,92 @@
+// Benchmark of identify_param() on host, on the wall clock, over all the encoders / variants registered:
+//   bench_identify [nb_loops]
+// One JSON line per kind of packet: packets of each encoder, unknown packets of the same length and header
+// as some encoders, and of other lengths. The time per packet of identify_param() with the dispatch index
+// (including the formatting of the config logged for a decoded packet) is given along with the one of trying
+// all the encoders in turn, as done before the index, with the same re-encode check.
+
+#include "harness/encoders.h"
+#include "harness/primitives.h"
+#include "harness/test.h"
+
+#include <cstdlib>
+
+using namespace esphome::bleadvcontroller;
+
+// access to the re-encode check done by identify_param() on the decoded packets
+struct IdentifyHandler: public BleAdvHandler {
+  using BleAdvHandler::check_reencode;
+};
+
+static void run(IdentifyHandler & handler, const char * name, const std::vector< BleAdvParam > & packets, uint32_t nb_loops) {
+  std::vector< BleAdvEncoder * > encoders;
+  for (uint8_t handle = 0; BleAdvEncoder * encoder = handler.get_encoder(handle); ++handle) {
+    encoders.push_back(encoder);
+  }
+  uint32_t nb_identified = 0;
+  double index_ns = host::time_ns(nb_loops, [&](uint32_t) {
+    for (auto & packet : packets) nb_identified += handler.identify_param(packet, true);
+  });
+  uint32_t nb_decoded = 0;
+  double all_ns = host::time_ns(nb_loops, [&](uint32_t) {
+    for (auto & packet : packets) {
+      for (auto encoder : encoders) {
+        Command cmd(CommandType::CUSTOM);
+        ControllerParam_t cont;
+        if (encoder->decode(packet, cmd, cont)) {
+          nb_decoded += handler.check_reencode(encoder, packet, cmd, cont);
+          break;
+        }
+      }
+    }
+  });
+  printf("{\"identify\":\"%s\",\"packets\":%d,\"loops\":%d,\"index_ns\":%.0f,\"all_encoders_ns\":%.0f,\"identified\":%d}\n",
+         name, (int)packets.size(), nb_loops, index_ns / packets.size(), all_ns / packets.size(), nb_identified / nb_loops);
+  CHECK(nb_identified == nb_decoded);
+}
+
+int main(int argc, char ** argv) {
+  uint32_t nb_loops = (argc > 1) ? atoi(argv[1]) : 1000;
+  esphome::host_log_level = ESPHOME_LOG_LEVEL_ERROR;
+  IdentifyHandler handler;
+  host::register_encoders(handler);
+  srand(1);
+
+  // 4 commands of random controllers per encoder
+  std::vector< BleAdvParam > known;
+  std::vector< BleAdvParam > same_header;
+  for (uint8_t handle = 0; BleAdvEncoder * encoder = handler.get_encoder(handle); ++handle) {
+    if (encoder->get_data_len() == 0) continue;
+    for (size_t i = 0; i < 4; ++i) {
+      Command cmd(CommandType::LIGHT_ON);
+      ControllerParam_t cont;
+      cont.id_ = rand() & 0xFFFF;
+      std::vector< BleAdvParam > params;
+      encoder->encode(params, cmd, cont);
+      uint8_t buf[MAX_PACKET_LEN];
+      uint8_t len = params.back().get_full_len();
+      std::copy(params.back().get_full_buf(), params.back().get_full_buf() + len, buf);
+      known.emplace_back();
+      known.back().from_raw(buf, len);
+      // the same packet corrupted after its header: only the encoders with this length and header try to decode it
+      buf[len - 8] ^= 0x5A;
+      same_header.emplace_back();
+      same_header.back().from_raw(buf, len);
+    }
+  }
+  // random payloads of all lengths with an AD flag section, as advertised by other devices
+  std::vector< BleAdvParam > other;
+  for (size_t i = 0; i < 64; ++i) {
+    uint8_t buf[MAX_PACKET_LEN] = {0x02, 0x01, 0x02};
+    uint8_t len = 5 + rand() % (sizeof(buf) - 4);
+    buf[3] = len - 4;
+    for (size_t j = 4; j < len; ++j) buf[j] = rand() & 0xFF;
+    other.emplace_back();
+    other.back().from_raw(buf, len);
+  }
+
+  run(handler, "known", known, nb_loops);
+  run(handler, "same_header", same_header, nb_loops);
+  run(handler, "other", other, nb_loops);
+  return host::test_result("bench_identify");
+}
@@ -0,0 +1,62 @@
+// Benchmark of the AES backends of the FanLamp signature on host, on the wall clock:
+//   bench_sign [nb_loops]
+// One JSON line per backend, with the time per block encrypted with a new key at each call, as when encoding,
+// and with the same key, as when re encoding a decoded packet. The 'hardware' backend is the one of the esp_aes
+// stub on host, an independent straightforward AES: the blocks of all the backends are checked to be the same.
+
+#include "harness/primitives.h"
+#include "harness/test.h"
+
+#include "sign_engine.h"
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace esphome::bleadvcontroller;
+
+int main(int argc, char ** argv) {
+  uint32_t nb_loops = (argc > 1) ? atoi(argv[1]) : 100000;
+  srand(1);
+
+  SoftSignEngine soft;
+  ScheduleSignEngine schedule;
+  HwSignEngine hw;
+  SignEngine * engines[] = {&soft, &schedule, &hw};
+
+  // same block from all the backends, for random keys and blocks, with a key used twice in a row from time to time
+  uint32_t nb_diffs = 0;
+  uint16_t seed = 0;
+  uint8_t tx_count = 0;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    if (rand() % 4 != 0) {
+      seed = rand() & 0xFFFF;
+      tx_count = rand() & 0xFF;
+    }
+    uint8_t in[16];
+    for (auto & b : in) b = rand() & 0xFF;
+    uint8_t ref[16];
+    hw.encrypt(in, ref, seed, tx_count);
+    for (auto engine : engines) {
+      uint8_t out[16];
+      engine->encrypt(in, out, seed, tx_count);
+      nb_diffs += (memcmp(out, ref, sizeof(out)) != 0);
+    }
+  }
+  CHECK(nb_diffs == 0);
+
+  uint8_t in[16]{0};
+  uint8_t out[16];
+  for (auto engine : engines) {
+    double new_key_ns = host::time_ns(nb_loops, [&](uint32_t i) {
+      in[0] = out[0];
+      engine->encrypt(in, out, i >> 7, i & 0x7F);
+    });
+    double same_key_ns = host::time_ns(nb_loops, [&](uint32_t i) {
+      in[0] = out[0];
+      engine->encrypt(in, out, 0x1234, 0x56);
+    });
+    printf("{\"sign_engine\":\"%s\",\"loops\":%d,\"new_key_ns\":%.0f,\"same_key_ns\":%.0f}\n",
+           engine->get_name(), nb_loops, new_key_ns, same_key_ns);
+  }
+  return host::test_result("bench_sign");
+}
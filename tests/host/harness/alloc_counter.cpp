@@ -0,0 +1,20 @@
+#include "alloc_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+static uint32_t nb_allocs = 0;
+
+void * operator new(size_t size) {
+  nb_allocs++;
+  if (void * ptr = malloc(size ? size : 1)) return ptr;
+  throw std::bad_alloc();
+}
+void operator delete(void * ptr) noexcept { free(ptr); }
+void operator delete(void * ptr, size_t) noexcept { free(ptr); }
+
+namespace host {
+
+uint32_t get_nb_allocs() { return nb_allocs; }
+
+} // namespace host
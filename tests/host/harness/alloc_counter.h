@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+namespace host {
+
+// Number of heap allocations done so far, by the replaced global operator new of harness/alloc_counter.cpp,
+// to be added to the sources of the executable
+uint32_t get_nb_allocs();
+
+} // namespace host
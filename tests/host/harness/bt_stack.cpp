@@ -0,0 +1,100 @@
+#include "bt_stack.h"
+#include "sim.h"
+
+#include "esphome/components/esp32_ble/ble.h"
+
+#include <algorithm>
+
+namespace host {
+
+using esphome::esp32_ble::global_ble;
+
+BtStack & BtStack::get() {
+  static BtStack stack;
+  return stack;
+}
+
+esp_err_t BtStack::request(esp_gap_ble_cb_event_t event, uint8_t instance) {
+  if (!global_ble->is_active() || (instance >= MAX_INSTANCES)) {
+    this->nb_refused_++;
+    return ESP_ERR_INVALID_STATE;
+  }
+  Sim::get().after_us(this->latency_us_, [this, event, instance]() { this->execute(event, instance); });
+  return ESP_OK;
+}
+
+void BtStack::execute(esp_gap_ble_cb_event_t event, uint8_t instance) {
+  esp_ble_gap_cb_param_t param = {};
+  esp_bt_status_t status = ESP_BT_STATUS_SUCCESS;
+  switch (event) {
+    case ESP_GAP_BLE_EXT_ADV_SET_PARAMS_COMPLETE_EVT:
+      this->params_set_[instance] = (instance < this->nb_sets_);
+      status = this->params_set_[instance] ? ESP_BT_STATUS_SUCCESS : ESP_BT_STATUS_FAIL;
+      param.ext_adv_set_params = { status, instance };
+      break;
+    case ESP_GAP_BLE_EXT_ADV_DATA_SET_COMPLETE_EVT:
+      status = this->params_set_[instance] ? ESP_BT_STATUS_SUCCESS : ESP_BT_STATUS_FAIL;
+      param.ext_adv_data_set = { status, instance };
+      break;
+    case ESP_GAP_BLE_EXT_ADV_START_COMPLETE_EVT:
+    case ESP_GAP_BLE_ADV_START_COMPLETE_EVT:
+      status = this->advertising_[instance] ? ESP_BT_STATUS_FAIL : ESP_BT_STATUS_SUCCESS;
+      if (event == ESP_GAP_BLE_ADV_START_COMPLETE_EVT) {
+        param.adv_start_cmpl.status = status;
+      } else {
+        param.ext_adv_start.status = status;
+        param.ext_adv_start.instance_num = 1;
+        param.ext_adv_start.instance[0] = instance;
+      }
+      if (status == ESP_BT_STATUS_SUCCESS) {
+        this->advertising_[instance] = true;
+        this->nb_starts_++;
+        uint8_t nb_advertising = 0;
+        for (bool advertising : this->advertising_) nb_advertising += advertising;
+        this->max_advertising_ = std::max(this->max_advertising_, nb_advertising);
+      }
+      break;
+    case ESP_GAP_BLE_EXT_ADV_STOP_COMPLETE_EVT:
+    case ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT:
+      status = this->advertising_[instance] ? ESP_BT_STATUS_SUCCESS : ESP_BT_STATUS_FAIL;
+      if (event == ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT) {
+        param.adv_stop_cmpl.status = status;
+      } else {
+        param.ext_adv_stop.status = status;
+        param.ext_adv_stop.instance_num = 1;
+        param.ext_adv_stop.instance[0] = instance;
+      }
+      this->advertising_[instance] = false;
+      break;
+    default:
+      param.adv_data_raw_cmpl.status = status;
+      break;
+  }
+  Sim::get().post_to_loop(0, [event, param]() mutable { global_ble->dispatch_gap_event(event, &param); });
+}
+
+} // namespace host
+
+using host::BtStack;
+
+esp_err_t esp_ble_gap_config_adv_data_raw(uint8_t * raw_data, uint32_t raw_data_len) {
+  return BtStack::get().request(ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT, 0);
+}
+esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t * adv_params) {
+  return BtStack::get().request(ESP_GAP_BLE_ADV_START_COMPLETE_EVT, 0);
+}
+esp_err_t esp_ble_gap_stop_advertising(void) {
+  return BtStack::get().request(ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT, 0);
+}
+esp_err_t esp_ble_gap_ext_adv_set_params(uint8_t instance, const esp_ble_gap_ext_adv_params_t * params) {
+  return BtStack::get().request(ESP_GAP_BLE_EXT_ADV_SET_PARAMS_COMPLETE_EVT, instance);
+}
+esp_err_t esp_ble_gap_config_ext_adv_data_raw(uint8_t instance, uint16_t length, const uint8_t * data) {
+  return BtStack::get().request(ESP_GAP_BLE_EXT_ADV_DATA_SET_COMPLETE_EVT, instance);
+}
+esp_err_t esp_ble_gap_ext_adv_start(uint8_t num_adv, const esp_ble_gap_ext_adv_t * ext_adv) {
+  return BtStack::get().request(ESP_GAP_BLE_EXT_ADV_START_COMPLETE_EVT, ext_adv[0].instance);
+}
+esp_err_t esp_ble_gap_ext_adv_stop(uint8_t num_adv, const uint8_t * ext_adv_inst) {
+  return BtStack::get().request(ESP_GAP_BLE_EXT_ADV_STOP_COMPLETE_EVT, ext_adv_inst[0]);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <esp_gap_ble_api.h>
+
+#include <cstdint>
+
+namespace host {
+
+/**
+  BtStack: the IDF GAP advertising API on host, used by the ESP-IDF shims of the Advertiser.
+    The requests are refused until esp32_ble enabled the stack, in its first loop, then executed
+    after latency_us_, their completion event being dispatched by esp32_ble in the main loop.
+    The controller only accepts the parameters of the first nb_sets_ extended advertising sets.
+ */
+class BtStack
+{
+public:
+  static constexpr uint8_t MAX_INSTANCES = 10;
+  static BtStack & get();
+
+  uint8_t nb_sets_{MAX_INSTANCES};
+  uint32_t latency_us_{1000};
+
+  bool is_advertising(uint8_t instance) const { return this->advertising_[instance]; }
+  // requests refused as the stack was not enabled
+  uint32_t get_nb_refused() const { return this->nb_refused_; }
+  uint32_t get_nb_starts() const { return this->nb_starts_; }
+  // maximum number of sets advertising at the same time
+  uint8_t get_max_advertising() const { return this->max_advertising_; }
+
+  esp_err_t request(esp_gap_ble_cb_event_t event, uint8_t instance);
+
+protected:
+  void execute(esp_gap_ble_cb_event_t event, uint8_t instance);
+
+  bool params_set_[MAX_INSTANCES]{false};
+  bool advertising_[MAX_INSTANCES]{false};
+  uint32_t nb_refused_{0};
+  uint32_t nb_starts_{0};
+  uint8_t max_advertising_{0};
+};
+
+} // namespace host
@@ -0,0 +1,45 @@
+#include "encoders.h"
+
+#include "fanlamp_pro.h"
+#include "zhijia.h"
+
+namespace host {
+
+using namespace esphome::bleadvcontroller;
+
+void register_encoders(BleAdvHandler & handler) {
+  // generated at build time from BLE_ADV_ENCODERS by gen_encoders.py
+#include "encoders.inc"
+}
+
+BleAdvController * make_controller(BleAdvHandler & handler, const ControllerConfig & config) {
+  auto * cont = new BleAdvController();
+  cont->set_setup_priority(300);
+  cont->set_name(config.name);
+  cont->set_object_id(config.name);
+  cont->set_handler(&handler);
+  // room in the advertiser queue for the biggest command: one packet per variant when using 'All', only selectable if shown
+  size_t nb_variants = 1;
+  if (config.show_config) {
+    nb_variants = handler.get_handles(handler.get_encoding_handle(config.encoding)).size() - 1;
+  }
+  handler.reserve_queue(2 * nb_variants);
+  cont->set_encoding_and_variant(config.encoding, config.variant);
+  cont->set_min_tx_duration(config.duration, 100, 500, 10);
+  cont->set_max_tx_duration(config.max_duration);
+  cont->set_seq_duration(config.seq_duration);
+  cont->set_adaptive_duration(config.adaptive_duration, config.duration_floor, config.adaptive_backlog);
+  cont->set_reversed(false);
+  if (config.forced_id > 0) {
+    cont->set_forced_id(config.forced_id);
+  } else {
+    cont->set_forced_id(config.name);
+  }
+  cont->set_index(config.index);
+  cont->set_show_config(config.show_config);
+  cont->set_priority(config.priority);
+  cont->set_weight(config.weight);
+  return cont;
+}
+
+} // namespace host
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "ble_adv_controller.h"
+
+namespace host {
+
+using esphome::bleadvcontroller::BleAdvController;
+using esphome::bleadvcontroller::BleAdvHandler;
+
+// Registration of all the encoders in the handler, as generated by the python codegen from BLE_ADV_ENCODERS,
+// the registration code being generated from it at build time (harness/gen_encoders.py)
+void register_encoders(BleAdvHandler & handler);
+
+// Controller options, with the defaults of the yaml schema
+struct ControllerConfig {
+  const char * name;
+  const char * encoding;
+  const char * variant;
+  uint32_t forced_id{0};
+  uint8_t index{0};
+  int duration{200};
+  uint32_t max_duration{3000};
+  uint32_t seq_duration{100};
+  bool show_config{false};
+  uint8_t priority{0};
+  uint8_t weight{1};
+  bool adaptive_duration{false};
+  // floor of the encoder if 0
+  uint32_t duration_floor{0};
+  size_t adaptive_backlog{4};
+};
+
+// Controller created and registered in the handler as the python codegen does, to be added to the Sim
+BleAdvController * make_controller(BleAdvHandler & handler, const ControllerConfig & config);
+
+} // namespace host
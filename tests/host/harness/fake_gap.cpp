@@ -0,0 +1,127 @@
+#include "fake_gap.h"
+#include "sim.h"
+
+#include "esphome/core/helpers.h"
+
+namespace host {
+
+using namespace esphome::bleadvcontroller;
+
+bool FakeGap::check(uint8_t set, bool allowed, const char * request) {
+  this->nb_requests_++;
+  // the GAP API is not to be called concurrently with the main loop
+  if (this->in_timer_task_) {
+    this->nb_timer_task_requests_++;
+    this->nb_errors_++;
+    fprintf(stderr, "%.3f ms - FakeGap: %s requested from the timer task on set %d\n", Sim::get().now_us() / 1000.0, request, set);
+    return false;
+  }
+  if ((set < this->nb_sets_) && allowed && !this->sets_[set].busy_) {
+    this->sets_[set].busy_ = true;
+    return true;
+  }
+  this->nb_errors_++;
+  fprintf(stderr, "%.3f ms - FakeGap: %s refused on set %d\n", Sim::get().now_us() / 1000.0, request, set);
+  return false;
+}
+
+void FakeGap::start_air(uint8_t set) {
+  SetState & state = this->sets_[set];
+  Air air{set, Sim::get().now_us(), UINT64_MAX, state.len_, {0}};
+  std::copy(state.buf_, state.buf_ + state.len_, air.buf_);
+  state.air_ = this->airs_.size();
+  this->airs_.push_back(air);
+}
+
+void FakeGap::end_air(uint8_t set) {
+  this->airs_[this->sets_[set].air_].end_us_ = Sim::get().now_us();
+}
+
+esp_err_t FakeGap::config_adv_data_raw(uint8_t set, uint8_t * buf, size_t len) {
+  // the data of an advertising set can be changed on air
+  if (!this->check(set, len <= MAX_PACKET_LEN, "config")) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  std::vector< uint8_t > data(buf, buf + len);
+  Sim::get().after_us(this->latency_us_, [this, set, data]() {
+    SetState & state = this->sets_[set];
+    std::copy(data.begin(), data.end(), state.buf_);
+    state.len_ = data.size();
+    if (state.advertising_) {
+      this->end_air(set);
+      this->start_air(set);
+    }
+    state.busy_ = false;
+    Sim::get().post_to_loop(0, [this, set]() { this->handler_->on_config_complete(set, true); });
+  });
+  return ESP_OK;
+}
+
+esp_err_t FakeGap::start_advertising(uint8_t set) {
+  if (!this->check(set, !this->sets_[set].advertising_, "start")) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  Sim::get().after_us(this->latency_us_, [this, set]() {
+    this->sets_[set].advertising_ = true;
+    this->sets_[set].busy_ = false;
+    this->start_air(set);
+    Sim::get().post_to_loop(0, [this, set]() { this->handler_->on_start_complete(set, true); });
+  });
+  return ESP_OK;
+}
+
+esp_err_t FakeGap::stop_advertising(uint8_t set) {
+  if (!this->check(set, this->sets_[set].advertising_, "stop")) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  Sim::get().after_us(this->latency_us_, [this, set]() {
+    this->sets_[set].advertising_ = false;
+    this->sets_[set].busy_ = false;
+    this->end_air(set);
+    Sim::get().post_to_loop(0, [this, set]() { this->handler_->on_stop_complete(set, true); });
+  });
+  return ESP_OK;
+}
+
+void FakeGap::start_timer(uint8_t set, uint32_t duration_ms) {
+  // as esp_timer_start_once, refused if already running
+  if (this->sets_[set].timer_running_) {
+    this->nb_errors_++;
+    fprintf(stderr, "%.3f ms - FakeGap: timer already running on set %d\n", Sim::get().now_us() / 1000.0, set);
+    return;
+  }
+  this->sets_[set].timer_running_ = true;
+  Sim::get().after_us((uint64_t)duration_ms * 1000, [this, set]() {
+    this->sets_[set].timer_running_ = false;
+    this->in_timer_task_ = true;
+    this->handler_->on_adv_timer(set);
+    this->in_timer_task_ = false;
+  });
+}
+
+std::string describe_packet(BleAdvHandler & handler, const uint8_t * buf, uint8_t len) {
+  BleAdvParam param;
+  param.from_raw(buf, len);
+  BleAdvEncoder * encoder = nullptr;
+  for (uint8_t handle = 0; (encoder = handler.get_encoder(handle)) != nullptr; ++handle) {
+    Command cmd(CommandType::CUSTOM);
+    ControllerParam_t cont;
+    if ((encoder->get_data_len() != 0) && encoder->decode(param, cmd, cont)) {
+      char desc[128];
+      snprintf(desc, sizeof(desc), "%s, id 0x%X, tx %d, cmd 0x%02X [%d,%d,%d,%d]", encoder->get_id().c_str(), cont.id_,
+               cont.tx_count_, cmd.cmd_, cmd.args_[0], cmd.args_[1], cmd.args_[2], cmd.args_[3]);
+      return desc;
+    }
+  }
+  return esphome::format_hex_pretty(buf, len);
+}
+
+void print_timeline(FILE * out, BleAdvHandler & handler, const FakeGap & gap) {
+  for (auto & air : gap.get_airs()) {
+    double end_ms = air.is_on_air() ? Sim::get().now_us() / 1000.0 : air.end_us_ / 1000.0;
+    fprintf(out, "%10.3f %10.3f set %d %s%s\n", air.start_us_ / 1000.0, end_ms, air.set_,
+            describe_packet(handler, air.buf_, air.len_).c_str(), air.is_on_air() ? " (on air)" : "");
+  }
+}
+
+} // namespace host
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "ble_adv_handler.h"
+
+#include <cstdio>
+#include <vector>
+
+namespace host {
+
+using esphome::bleadvcontroller::BleAdvGap;
+using esphome::bleadvcontroller::BleAdvHandler;
+using esphome::bleadvcontroller::MAX_ADV_SETS;
+using esphome::bleadvcontroller::MAX_PACKET_LEN;
+
+/**
+  FakeGap: BleAdvGap recording the requests of the Advertiser, in place of the ESP-IDF GAP.
+    Each request is executed by the BLE stack after latency_us_, its completion event being then posted
+    to the main loop as esp32_ble does. The timers are run at their expiry time, as from the timer task.
+    The packets on air are recorded per set: the on air timeline.
+    The requests not allowed in the current state of the set, or issued from the timer task, are refused and counted as errors.
+ */
+class FakeGap: public BleAdvGap
+{
+public:
+  FakeGap(uint8_t nb_sets = 1): nb_sets_(nb_sets) {}
+
+  void init(BleAdvHandler * handler, esp_ble_adv_params_t * params) override { this->handler_ = handler; }
+  uint8_t get_nb_sets() const override { return this->nb_sets_; }
+  esp_err_t config_adv_data_raw(uint8_t set, uint8_t * buf, size_t len) override;
+  esp_err_t start_advertising(uint8_t set) override;
+  esp_err_t stop_advertising(uint8_t set) override;
+  void start_timer(uint8_t set, uint32_t duration_ms) override;
+  void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) override {}
+
+  struct Air {
+    uint8_t set_;
+    uint64_t start_us_;
+    uint64_t end_us_;
+    uint8_t len_;
+    uint8_t buf_[MAX_PACKET_LEN];
+    bool is_on_air() const { return this->end_us_ == UINT64_MAX; }
+  };
+  const std::vector< Air > & get_airs() const { return this->airs_; }
+  bool is_advertising(uint8_t set) const { return this->sets_[set].advertising_; }
+  uint32_t get_nb_requests() const { return this->nb_requests_; }
+  uint32_t get_nb_errors() const { return this->nb_errors_; }
+  uint32_t get_nb_timer_task_requests() const { return this->nb_timer_task_requests_; }
+
+  // time for the BLE stack to execute a request
+  uint32_t latency_us_{1000};
+
+protected:
+  bool check(uint8_t set, bool allowed, const char * request);
+  void start_air(uint8_t set);
+  void end_air(uint8_t set);
+
+  struct SetState {
+    bool busy_{false};
+    bool advertising_{false};
+    uint8_t len_{0};
+    uint8_t buf_[MAX_PACKET_LEN]{0};
+    size_t air_{0};
+    bool timer_running_{false};
+  };
+  uint8_t nb_sets_;
+  SetState sets_[MAX_ADV_SETS];
+  BleAdvHandler * handler_{nullptr};
+  std::vector< Air > airs_;
+  uint32_t nb_requests_{0};
+  uint32_t nb_errors_{0};
+  uint32_t nb_timer_task_requests_{0};
+  bool in_timer_task_{false};
+};
+
+// Encoder, controller id and command of a packet, as decoded by the encoders registered in the handler
+std::string describe_packet(BleAdvHandler & handler, const uint8_t * buf, uint8_t len);
+
+// One line per packet on air: start / end time in ms, set and packet description
+void print_timeline(FILE * out, BleAdvHandler & handler, const FakeGap & gap);
+
+} // namespace host
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+"""Registration of all the encoders in the handler, generated from BLE_ADV_ENCODERS as the python codegen does.
+
+The component __init__.py is parsed, not imported, esphome not being needed on host:
+  gen_encoders.py <component __init__.py> <output .inc>
+"""
+import ast
+import sys
+
+
+def cpp_arg(value):
+    if isinstance(value, bool):
+        return "true" if value else "false"
+    if isinstance(value, int):
+        return "0x%02X" % value
+    if isinstance(value, str):
+        return '"%s"' % value
+    if isinstance(value, list):
+        return "{%s}" % ", ".join(cpp_arg(v) for v in value)
+    raise ValueError("Unsupported encoder arg: %r" % (value,))
+
+
+def get_encoders(path):
+    with open(path) as f:
+        tree = ast.parse(f.read(), path)
+    for node in tree.body:
+        if isinstance(node, ast.Assign) and any(getattr(t, "id", None) == "BLE_ADV_ENCODERS" for t in node.targets):
+            return node.value
+    raise ValueError("BLE_ADV_ENCODERS not found in %s" % path)
+
+
+def main(src, out):
+    lines = ["// Generated by gen_encoders.py from BLE_ADV_ENCODERS of %s, do not edit" % src.split("/components/")[-1]]
+    encodings = get_encoders(src)
+    for enc_key, enc_node in zip(encodings.keys, encodings.values):
+        encoding = ast.literal_eval(enc_key)
+        params = dict(zip((ast.literal_eval(k) for k in enc_node.keys), enc_node.values))
+        variants = params["variants"]
+        for var_key, var_node in zip(variants.keys, variants.values):
+            variant = ast.literal_eval(var_key)
+            fields = dict(zip((ast.literal_eval(k) for k in var_node.keys), var_node.values))
+            if "class" not in fields:
+                continue
+            enc_class = fields["class"].id
+            template = ", ".join([enc_class] + [cpp_arg(v) for v in ast.literal_eval(fields["ble_param"]) + ast.literal_eval(fields["header"])])
+            args = ", ".join([cpp_arg(encoding), cpp_arg(variant)] + [cpp_arg(v) for v in ast.literal_eval(fields["args"])])
+            lines.append("{")
+            lines.append("  auto * enc = new BleAdvStaticEncoder< %s >(%s);" % (template, args))
+            lines.append("  enc->set_duration_floor(%d);" % ast.literal_eval(fields["duration_floor"]))
+            lines.append("  handler.add_encoder(enc);")
+            lines.append("}")
+    content = "\n".join(lines) + "\n"
+    # only rewritten if changed, not to rebuild the harness at each run
+    try:
+        with open(out) as f:
+            if f.read() == content:
+                return
+    except OSError:
+        pass
+    with open(out, "w") as f:
+        f.write(content)
+
+
+if __name__ == "__main__":
+    main(sys.argv[1], sys.argv[2])
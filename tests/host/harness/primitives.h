@@ -0,0 +1,86 @@
+#pragma once
+
+#include "fanlamp_pro.h"
+#include "zhijia.h"
+
+#include <chrono>
+
+namespace host {
+
+using namespace esphome::bleadvcontroller;
+
+// Access to the encoding utils of the encoders, with their previous bit by bit implementation as reference
+struct Primitives: public BleAdvEncoder {
+  Primitives(): BleAdvEncoder("host", "primitives") {}
+  Commands translate(const Command & cmd, const ControllerParam_t & cont) override { return Commands(); }
+  void encode(std::vector< BleAdvParam > & params, Command & cmd, ControllerParam_t & cont) override {}
+
+  using BleAdvEncoder::whiten;
+  using BleAdvEncoder::crc16_8408;
+  using BleAdvEncoder::crc16_1021;
+
+  // 7 bits LFSR, 8 steps per byte
+  static void ref_whiten(uint8_t * buf, size_t len, uint8_t seed) {
+    uint8_t r = seed;
+    for (size_t i = 0; i < len; i++) {
+      uint8_t b = 0;
+      for (size_t j = 0; j < 8; j++) {
+        r <<= 1;
+        if (r & 0x80) {
+          r ^= 0x11;
+          b |= 1 << j;
+        }
+        r &= 0x7F;
+      }
+      buf[i] ^= b;
+    }
+  }
+
+  // esphome::crc16 and esphome::crc16be, as used by the encoders before the tables
+  static uint16_t ref_crc16(const uint8_t * data, size_t len, uint16_t crc, uint16_t reverse_poly, bool refin, bool refout) {
+    if (refin) crc ^= 0xffff;
+    while (len--) {
+      crc ^= *data++;
+      for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 0x0001) ? ((crc >> 1) ^ reverse_poly) : (crc >> 1);
+      }
+    }
+    return refout ? (crc ^ 0xffff) : crc;
+  }
+  static uint16_t ref_crc16be(const uint8_t * data, size_t len, uint16_t crc, uint16_t poly, bool refin, bool refout) {
+    if (refin) crc ^= 0xffff;
+    while (len--) {
+      crc ^= (((uint16_t) *data++) << 8);
+      for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 0x8000) ? ((crc << 1) ^ poly) : (crc << 1);
+      }
+    }
+    return refout ? (crc ^ 0xffff) : crc;
+  }
+};
+
+// The crc16 of the encoder families
+struct ZhijiaPrimitives: public ZhijiaEncoder {
+  ZhijiaPrimitives(): ZhijiaEncoder("host", "zhijia") {}
+  Commands translate(const Command & cmd, const ControllerParam_t & cont) override { return Commands(); }
+  void encode(std::vector< BleAdvParam > & params, Command & cmd, ControllerParam_t & cont) override {}
+  using ZhijiaEncoder::crc16;
+};
+
+struct FanLampPrimitives: public FanLampEncoder {
+  FanLampPrimitives(): FanLampEncoder("host", "fanlamp", {}) {}
+  void encode(std::vector< BleAdvParam > & params, Command & cmd, ControllerParam_t & cont) override {}
+  using FanLampEncoder::crc16;
+};
+
+// average time per call of fn, in ns, on the wall clock
+template< typename Fn > double time_ns(uint32_t nb_loops, Fn fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < nb_loops; ++i) {
+    fn(i);
+  }
+  std::chrono::duration< double, std::nano > elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / nb_loops;
+}
+
+} // namespace host
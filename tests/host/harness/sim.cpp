@@ -0,0 +1,136 @@
+#include "sim.h"
+
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
+#include "esphome/components/esp32_ble/ble.h"
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace host {
+
+Sim & Sim::get() {
+  static Sim sim;
+  return sim;
+}
+
+void Sim::reset() {
+  this->events_.clear();
+  this->posted_.clear();
+  this->components_.clear();
+  this->components_.push_back(esphome::esp32_ble::global_ble);
+  this->now_us_ = START_US;
+  this->next_loop_us_ = START_US;
+  this->nb_loops_ = 0;
+}
+
+void Sim::setup() {
+  std::stable_sort(this->components_.begin(), this->components_.end(), [](esphome::Component * a, esphome::Component * b) {
+    return a->get_actual_setup_priority() > b->get_actual_setup_priority();
+  });
+  for (auto * component : this->components_) {
+    component->setup();
+  }
+}
+
+uint32_t Sim::at_us(uint64_t time_us, Action action) {
+  uint32_t id = this->next_id_++;
+  this->events_.emplace(std::max(time_us, this->now_us_), Event{id, std::move(action)});
+  return id;
+}
+
+bool Sim::cancel(uint32_t id) {
+  for (auto it = this->events_.begin(); it != this->events_.end(); ++it) {
+    if (it->second.id_ == id) {
+      this->events_.erase(it);
+      return true;
+    }
+  }
+  return false;
+}
+
+void Sim::post_to_loop(uint64_t delay_us, Action action) {
+  this->posted_.emplace_back(this->now_us_ + delay_us, std::move(action));
+}
+
+void Sim::loop_once() {
+  this->nb_loops_++;
+  // posted actions first, as the esp32_ble component loops before the others
+  std::vector< std::pair< uint64_t, Action > > ready;
+  auto not_ready = std::stable_partition(this->posted_.begin(), this->posted_.end(), 
+                      [&](const std::pair< uint64_t, Action > & p) { return p.first <= this->now_us_; });
+  std::move(this->posted_.begin(), not_ready, std::back_inserter(ready));
+  this->posted_.erase(this->posted_.begin(), not_ready);
+  for (auto & p : ready) {
+    p.second();
+  }
+  for (auto * component : this->components_) {
+    component->loop();
+  }
+}
+
+void Sim::run_until_us(uint64_t end_us) {
+  while (true) {
+    uint64_t next_event_us = this->events_.empty() ? UINT64_MAX : this->events_.begin()->first;
+    if ((this->next_loop_us_ <= end_us) && (this->next_loop_us_ < next_event_us)) {
+      this->now_us_ = this->next_loop_us_;
+      this->loop_once();
+      bool high_freq = esphome::HighFrequencyLoopRequester::is_high_frequency();
+      this->next_loop_us_ = this->now_us_ + (high_freq ? this->high_freq_interval_us_ : this->loop_interval_us_);
+    } else if (next_event_us <= end_us) {
+      auto it = this->events_.begin();
+      this->now_us_ = it->first;
+      Action action = std::move(it->second.action_);
+      this->events_.erase(it);
+      action();
+    } else {
+      break;
+    }
+  }
+  this->now_us_ = end_us;
+}
+
+} // namespace host
+
+namespace esphome {
+static uint64_t wall_clock_us() {
+  using namespace std::chrono;
+  return duration_cast< microseconds >(steady_clock::now().time_since_epoch()).count();
+}
+uint32_t millis() { return host::Sim::get().wall_clock_ ? wall_clock_us() / 1000 : host::Sim::get().now_us() / 1000; }
+uint32_t micros() { return host::Sim::get().wall_clock_ ? wall_clock_us() : host::Sim::get().now_us(); }
+} // namespace esphome
+
+// esp_timer: one shot timers run by the Sim at their expiry
+struct esp_timer {
+  esp_timer_cb_t callback_;
+  void * arg_;
+  uint32_t event_id_;
+};
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t * create_args, esp_timer_handle_t * out_handle) {
+  *out_handle = new esp_timer{create_args->callback, create_args->arg, 0};
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+  if (timer->event_id_ != 0) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->event_id_ = host::Sim::get().after_us(timeout_us, [timer]() {
+    timer->event_id_ = 0;
+    timer->callback_(timer->arg_);
+  });
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  if ((timer->event_id_ == 0) || !host::Sim::get().cancel(timer->event_id_)) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->event_id_ = 0;
+  return ESP_OK;
+}
+
+int64_t esp_timer_get_time() { return host::Sim::get().now_us(); }
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "esphome/core/component.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace host {
+
+/**
+  Sim: discrete event simulation, in virtual time, of the ESPHome main loop and of the tasks interacting with it.
+    - the components are set up by decreasing setup priority, then looped in that order at each main loop iteration
+    - an iteration follows the previous one after the loop interval, or at once when a high frequency loop is requested
+    - the actions posted to the main loop, as the GAP events queued by esp32_ble, are run at the start of an iteration
+    - the timed actions, as the esp_timer callbacks, are run at their exact time as from another task
+  millis(), micros() and esp_timer_get_time() are giving the virtual time.
+ */
+class Sim
+{
+public:
+  using Action = std::function< void() >;
+  // not starting at 0, that is used as 'not started' by the components
+  static constexpr uint64_t START_US = 1000000;
+
+  static Sim & get();
+  // components removed, the esp32_ble one being always registered as dependency of the Advertiser
+  void reset();
+
+  uint64_t now_us() const { return this->now_us_; }
+  uint32_t now_ms() const { return this->now_us_ / 1000; }
+
+  void add_component(esphome::Component * component) { this->components_.push_back(component); }
+  void setup();
+  void run_for_ms(uint32_t duration_ms) { this->run_until_us(this->now_us_ + (uint64_t)duration_ms * 1000); }
+  void run_until_us(uint64_t end_us);
+
+  // action run at the given time as from another task, returns an id to cancel it
+  uint32_t at_us(uint64_t time_us, Action action);
+  uint32_t after_us(uint64_t delay_us, Action action) { return this->at_us(this->now_us_ + delay_us, std::move(action)); }
+  bool cancel(uint32_t id);
+  // action run by the main loop, at its first iteration after the delay
+  void post_to_loop(uint64_t delay_us, Action action);
+
+  uint32_t get_nb_loops() const { return this->nb_loops_; }
+
+  // ESPHome default loop interval, and time of a loop iteration when run without delay
+  uint32_t loop_interval_us_{16000};
+  uint32_t high_freq_interval_us_{200};
+  // millis() / micros() giving the real time instead, for the benchmarks
+  bool wall_clock_{false};
+
+protected:
+  Sim() { this->reset(); }
+  void loop_once();
+
+  struct Event {
+    uint32_t id_;
+    Action action_;
+  };
+  std::multimap< uint64_t, Event > events_;
+  std::vector< std::pair< uint64_t, Action > > posted_;
+  std::vector< esphome::Component * > components_;
+  uint64_t now_us_{START_US};
+  uint64_t next_loop_us_{START_US};
+  uint32_t next_id_{1};
+  uint32_t nb_loops_{0};
+};
+
+} // namespace host
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdio>
+
+// Minimal checks for the host tests: failures are reported and counted, the test exits with their number
+namespace host {
+
+inline int & nb_failures() {
+  static int nb = 0;
+  return nb;
+}
+
+inline bool check(bool ok, const char * expr, const char * file, int line) {
+  if (!ok) {
+    fprintf(stderr, "%s:%d: CHECK failed: %s\n", file, line, expr);
+    nb_failures()++;
+  }
+  return ok;
+}
+
+inline int test_result(const char * name) {
+  printf("%s: %s (%d failures)\n", name, (nb_failures() == 0) ? "OK" : "FAILED", nb_failures());
+  return (nb_failures() == 0) ? 0 : 1;
+}
+
+} // namespace host
+
+#define CHECK(cond) host::check((cond), #cond, __FILE__, __LINE__)
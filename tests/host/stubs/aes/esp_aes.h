@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+// Host build: portable AES-128 encryption, same interface as the IDF hardware AES driver
+#define ESP_AES_ENCRYPT 1
+#define ESP_AES_DECRYPT 0
+
+typedef struct {
+  uint8_t key_bytes;
+  uint8_t round_keys[176];
+} esp_aes_context;
+
+void esp_aes_init(esp_aes_context *ctx);
+void esp_aes_free(esp_aes_context *ctx);
+int esp_aes_setkey(esp_aes_context *ctx, const unsigned char *key, unsigned int keybits);
+int esp_aes_crypt_ecb(esp_aes_context *ctx, int mode, const unsigned char input[16], unsigned char output[16]);
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <esp_err.h>
+
+// Host build: subset of the IDF GAP API used by the ble_adv_controller sources
+
+#define ESP_BLE_AD_TYPE_FLAG 0x01
+#define ESP_BLE_AD_TYPE_16SRV_CMPL 0x03
+#define ESP_BLE_AD_TYPE_SERVICE_DATA 0x16
+#define ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE 0xFF
+
+#define ESP_BLE_ADV_DATA_LEN_MAX 31
+#define ESP_BLE_SCAN_RSP_DATA_LEN_MAX 31
+
+typedef uint8_t esp_bd_addr_t[6];
+
+typedef enum { ADV_TYPE_IND = 0x00, ADV_TYPE_NONCONN_IND = 0x03 } esp_ble_adv_type_t;
+typedef enum { BLE_ADDR_TYPE_PUBLIC = 0x00, BLE_ADDR_TYPE_RANDOM = 0x01 } esp_ble_addr_type_t;
+typedef enum { ADV_CHNL_37 = 0x01, ADV_CHNL_38 = 0x02, ADV_CHNL_39 = 0x04, ADV_CHNL_ALL = 0x07 } esp_ble_adv_channel_t;
+typedef enum { ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY = 0x00 } esp_ble_adv_filter_t;
+
+typedef struct {
+  uint16_t adv_int_min;
+  uint16_t adv_int_max;
+  esp_ble_adv_type_t adv_type;
+  esp_ble_addr_type_t own_addr_type;
+  esp_bd_addr_t peer_addr;
+  esp_ble_addr_type_t peer_addr_type;
+  esp_ble_adv_channel_t channel_map;
+  esp_ble_adv_filter_t adv_filter_policy;
+} esp_ble_adv_params_t;
+
+typedef enum {
+  ESP_BT_STATUS_SUCCESS = 0,
+  ESP_BT_STATUS_FAIL,
+  ESP_BT_STATUS_NOT_READY,
+  ESP_BT_STATUS_NOMEM,
+  ESP_BT_STATUS_BUSY,
+} esp_bt_status_t;
+
+typedef enum {
+  ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT = 0,
+  ESP_GAP_BLE_SCAN_RSP_DATA_SET_COMPLETE_EVT,
+  ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT,
+  ESP_GAP_BLE_SCAN_RESULT_EVT,
+  ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT,
+  ESP_GAP_BLE_SCAN_RSP_DATA_RAW_SET_COMPLETE_EVT,
+  ESP_GAP_BLE_ADV_START_COMPLETE_EVT,
+  ESP_GAP_BLE_SCAN_START_COMPLETE_EVT,
+  ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT = 17,
+  ESP_GAP_BLE_EXT_ADV_SET_PARAMS_COMPLETE_EVT = 32,
+  ESP_GAP_BLE_EXT_ADV_DATA_SET_COMPLETE_EVT = 33,
+  ESP_GAP_BLE_EXT_ADV_START_COMPLETE_EVT = 35,
+  ESP_GAP_BLE_EXT_ADV_STOP_COMPLETE_EVT = 36,
+} esp_gap_ble_cb_event_t;
+
+typedef union {
+  struct ble_adv_data_raw_cmpl_evt_param { esp_bt_status_t status; } adv_data_raw_cmpl;
+  struct ble_adv_start_cmpl_evt_param { esp_bt_status_t status; } adv_start_cmpl;
+  struct ble_adv_stop_cmpl_evt_param { esp_bt_status_t status; } adv_stop_cmpl;
+  struct ble_scan_result_evt_param {
+    esp_bd_addr_t bda;
+    uint8_t ble_adv[ESP_BLE_ADV_DATA_LEN_MAX + ESP_BLE_SCAN_RSP_DATA_LEN_MAX];
+    int rssi;
+    uint8_t adv_data_len;
+    uint8_t scan_rsp_len;
+  } scan_rst;
+  struct ble_adv_ext_set_params_cmpl_evt_param { esp_bt_status_t status; uint8_t instance; } ext_adv_set_params;
+  struct ble_adv_ext_data_set_cmpl_evt_param { esp_bt_status_t status; uint8_t instance; } ext_adv_data_set;
+  struct ble_adv_ext_start_cmpl_evt_param { esp_bt_status_t status; uint8_t instance_num; uint8_t instance[10]; } ext_adv_start;
+  struct ble_adv_ext_stop_cmpl_evt_param { esp_bt_status_t status; uint8_t instance_num; uint8_t instance[10]; } ext_adv_stop;
+} esp_ble_gap_cb_param_t;
+
+esp_err_t esp_ble_gap_config_adv_data_raw(uint8_t *raw_data, uint32_t raw_data_len);
+esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t *adv_params);
+esp_err_t esp_ble_gap_stop_advertising(void);
+
+// BLE 5 extended advertising
+typedef uint16_t esp_ble_ext_adv_type_mask_t;
+#define ESP_BLE_LEGACY_ADV_TYPE_NONCONN_IND (0x10)
+#define EXT_ADV_TX_PWR_NO_PREFERENCE (127)
+typedef uint8_t esp_ble_gap_pri_phy_t;
+typedef uint8_t esp_ble_gap_phy_t;
+#define ESP_BLE_GAP_PRI_PHY_1M 0x01
+#define ESP_BLE_GAP_PHY_1M 0x01
+
+typedef struct {
+  esp_ble_ext_adv_type_mask_t type;
+  uint32_t interval_min;
+  uint32_t interval_max;
+  esp_ble_adv_channel_t channel_map;
+  esp_ble_addr_type_t own_addr_type;
+  esp_ble_addr_type_t peer_addr_type;
+  esp_bd_addr_t peer_addr;
+  esp_ble_adv_filter_t filter_policy;
+  int8_t tx_power;
+  esp_ble_gap_pri_phy_t primary_phy;
+  uint8_t max_skip;
+  esp_ble_gap_phy_t secondary_phy;
+  uint8_t sid;
+  bool scan_req_notif;
+} esp_ble_gap_ext_adv_params_t;
+
+typedef struct {
+  uint8_t instance;
+  int duration;
+  int max_events;
+} esp_ble_gap_ext_adv_t;
+
+esp_err_t esp_ble_gap_ext_adv_set_params(uint8_t instance, const esp_ble_gap_ext_adv_params_t *params);
+esp_err_t esp_ble_gap_config_ext_adv_data_raw(uint8_t instance, uint16_t length, const uint8_t *data);
+esp_err_t esp_ble_gap_ext_adv_start(uint8_t num_adv, const esp_ble_gap_ext_adv_t *ext_adv);
+esp_err_t esp_ble_gap_ext_adv_stop(uint8_t num_adv, const uint8_t *ext_adv_inst);
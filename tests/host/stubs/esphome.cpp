@@ -0,0 +1,92 @@
+#include "esphome/core/application.h"
+#include "esphome/core/component.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/log.h"
+#include "esphome/core/preferences.h"
+#include "esphome/components/esp32_ble/ble.h"
+
+#include <cstdarg>
+
+namespace esphome {
+
+namespace setup_priority {
+const float BUS = 1000.0f;
+const float IO = 900.0f;
+const float HARDWARE = 800.0f;
+const float DATA = 600.0f;
+const float PROCESSOR = 400.0f;
+const float BLUETOOTH = 350.0f;
+const float AFTER_BLUETOOTH = 300.0f;
+const float WIFI = 250.0f;
+const float LATE = -100.0f;
+}  // namespace setup_priority
+
+float Component::get_setup_priority() const { return setup_priority::DATA; }
+
+float Component::get_actual_setup_priority() const {
+  return this->has_setup_priority_override_ ? this->setup_priority_override_ : this->get_setup_priority();
+}
+
+void Component::set_setup_priority(float priority) {
+  this->has_setup_priority_override_ = true;
+  this->setup_priority_override_ = priority;
+}
+
+uint8_t HighFrequencyLoopRequester::num_requests = 0;
+
+void HighFrequencyLoopRequester::start() {
+  if (this->started_) return;
+  num_requests++;
+  this->started_ = true;
+}
+
+void HighFrequencyLoopRequester::stop() {
+  if (!this->started_) return;
+  num_requests--;
+  this->started_ = false;
+}
+
+bool HighFrequencyLoopRequester::is_high_frequency() { return num_requests > 0; }
+
+std::string format_hex_pretty(const uint8_t *data, size_t length) {
+  if (length == 0) return "";
+  std::string ret;
+  char buf[4];
+  for (size_t i = 0; i < length; ++i) {
+    snprintf(buf, sizeof(buf), (i == 0) ? "%02X" : ".%02X", data[i]);
+    ret += buf;
+  }
+  return ret + " (" + std::to_string(length) + ")";
+}
+
+uint32_t fnv1_hash(const std::string &str) {
+  uint32_t hash = 2166136261UL;
+  for (char c : str) {
+    hash *= 16777619UL;
+    hash ^= c;
+  }
+  return hash;
+}
+
+int host_log_level = ESPHOME_LOG_LEVEL_WARN;
+
+void host_log(int level, const char *tag, const char *format, ...) {
+  static const char LEVELS[] = "?EWICDVV";
+  fprintf(stderr, "[%c][%s]: ", LEVELS[level & 7], tag);
+  va_list args;
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  fputc('\n', stderr);
+}
+
+Application App;
+static ESPPreferences host_preferences;
+ESPPreferences *global_preferences = &host_preferences;
+
+namespace esp32_ble {
+static ESP32BLE host_ble;
+ESP32BLE *global_ble = &host_ble;
+}  // namespace esp32_ble
+
+}  // namespace esphome
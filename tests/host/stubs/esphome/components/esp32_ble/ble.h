@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include <esp_gap_ble_api.h>
+#include "esphome/core/component.h"
+
+namespace esphome {
+namespace esp32_ble {
+
+class GAPEventHandler {
+ public:
+  virtual void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) = 0;
+};
+
+// Host build: the GAP events are dispatched by the simulated BLE stack, see harness/bt_stack.h.
+// As the ESPHome one, the stack is enabled in the first loop following the setup.
+class ESP32BLE : public Component {
+ public:
+  void loop() override { this->active_ = true; }
+  float get_setup_priority() const override { return setup_priority::BLUETOOTH; }
+  bool is_active() const { return this->active_; }
+  void register_gap_event_handler(GAPEventHandler *handler) { this->gap_event_handlers_.push_back(handler); }
+  void dispatch_gap_event(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param) {
+    for (auto *handler : this->gap_event_handlers_) {
+      handler->gap_event_handler(event, param);
+    }
+  }
+
+ protected:
+  bool active_{false};
+  std::vector< GAPEventHandler * > gap_event_handlers_;
+};
+
+extern ESP32BLE *global_ble;
+
+}  // namespace esp32_ble
+}  // namespace esphome
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <esp_gap_ble_api.h>
+
+namespace esphome {
+namespace esp32_ble_tracker {
+
+class ESPBTDevice {
+ public:
+  // Host build: the raw advertisement as received from the scan
+  void set_raw(const uint8_t *buf, uint8_t len) {
+    std::copy(buf, buf + len, this->scan_result_.ble_adv);
+    this->scan_result_.adv_data_len = len;
+  }
+
+ protected:
+  esp_ble_gap_cb_param_t::ble_scan_result_evt_param scan_result_{};
+};
+
+}  // namespace esp32_ble_tracker
+}  // namespace esphome
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cmath>
+#include <math.h>
+#include <initializer_list>
+#include <set>
+#include "esphome/core/component.h"
+#include "esphome/core/entity_base.h"
+#include "esphome/core/hal.h"
+
+namespace esphome {
+namespace light {
+
+enum class ColorMode : uint8_t {
+  UNKNOWN = 0,
+  ON_OFF = 1,
+  BRIGHTNESS = 2,
+  COLD_WARM_WHITE = 3,
+};
+
+class LightTraits {
+ public:
+  void set_supported_color_modes(std::initializer_list< ColorMode > modes) { this->modes_ = modes; }
+  bool supports_color_mode(ColorMode mode) const { return this->modes_.count(mode) > 0; }
+  float get_min_mireds() const { return this->min_mireds_; }
+  void set_min_mireds(float min_mireds) { this->min_mireds_ = min_mireds; }
+  float get_max_mireds() const { return this->max_mireds_; }
+  void set_max_mireds(float max_mireds) { this->max_mireds_ = max_mireds; }
+
+ protected:
+  std::set< ColorMode > modes_;
+  float min_mireds_{0};
+  float max_mireds_{0};
+};
+
+// Cold / warm white values only, the cold / warm channels being derived from the color temperature by the caller
+class LightColorValues {
+ public:
+  float get_state() const { return this->state_; }
+  void set_state(float state) { this->state_ = state; }
+  float get_brightness() const { return this->brightness_; }
+  void set_brightness(float brightness) { this->brightness_ = brightness; }
+  float get_color_temperature() const { return this->color_temperature_; }
+  void set_color_temperature(float color_temperature) { this->color_temperature_ = color_temperature; }
+  void set_cold_white(float cold_white) { this->cold_white_ = cold_white; }
+  void set_warm_white(float warm_white) { this->warm_white_ = warm_white; }
+
+  void as_cwww(float *cold_white, float *warm_white, float gamma = 0, bool constant_brightness = false) const {
+    float white = this->state_ * this->brightness_;
+    if (constant_brightness) {
+      float sum = this->cold_white_ + this->warm_white_;
+      *cold_white = (sum > 0) ? white * this->cold_white_ / sum : 0;
+      *warm_white = (sum > 0) ? white * this->warm_white_ / sum : 0;
+    } else {
+      *cold_white = white * this->cold_white_;
+      *warm_white = white * this->warm_white_;
+    }
+  }
+
+  static LightColorValues lerp(const LightColorValues &start, const LightColorValues &end, float completion) {
+    LightColorValues v;
+    v.state_ = start.state_ + (end.state_ - start.state_) * completion;
+    v.brightness_ = start.brightness_ + (end.brightness_ - start.brightness_) * completion;
+    v.color_temperature_ = start.color_temperature_ + (end.color_temperature_ - start.color_temperature_) * completion;
+    v.cold_white_ = start.cold_white_ + (end.cold_white_ - start.cold_white_) * completion;
+    v.warm_white_ = start.warm_white_ + (end.warm_white_ - start.warm_white_) * completion;
+    return v;
+  }
+
+  bool operator==(const LightColorValues &rhs) const {
+    return (this->state_ == rhs.state_) && (this->brightness_ == rhs.brightness_)
+        && (this->color_temperature_ == rhs.color_temperature_)
+        && (this->cold_white_ == rhs.cold_white_) && (this->warm_white_ == rhs.warm_white_);
+  }
+  bool operator!=(const LightColorValues &rhs) const { return !(*this == rhs); }
+
+ protected:
+  float state_{0};
+  float brightness_{1};
+  float color_temperature_{0};
+  float cold_white_{1};
+  float warm_white_{1};
+};
+
+class LightState;
+
+class LightOutput {
+ public:
+  virtual ~LightOutput() = default;
+  virtual LightTraits get_traits() = 0;
+  virtual void setup_state(LightState *state) {}
+  virtual void write_state(LightState *state) = 0;
+};
+
+/**
+  LightState: the transitions of a light, as run by ESPHome from its loop.
+    A new target (as from a LightCall) is reached linearly over the transition length,
+    the output being written at each loop iteration with the intermediate current values.
+ */
+class LightState : public EntityBase, public Component {
+ public:
+  LightState(LightOutput *output) : output_(output) {}
+
+  LightColorValues current_values;
+  LightColorValues remote_values;
+
+  void setup() override { this->output_->setup_state(this); }
+  void loop() override {
+    if (!this->in_transition_) return;
+    uint32_t elapsed = millis() - this->start_time_;
+    if (elapsed >= this->length_ms_) {
+      this->current_values = this->remote_values;
+      this->in_transition_ = false;
+    } else {
+      this->current_values = LightColorValues::lerp(this->start_values_, this->remote_values, (float)elapsed / this->length_ms_);
+    }
+    this->output_->write_state(this);
+  }
+
+  void start_transition(const LightColorValues &target, uint32_t length_ms) {
+    this->start_values_ = this->current_values;
+    this->remote_values = target;
+    this->start_time_ = millis();
+    this->length_ms_ = length_ms;
+    this->in_transition_ = true;
+  }
+  bool is_transition_active() const { return this->in_transition_; }
+
+  void current_values_as_binary(bool *binary) { *binary = this->current_values.get_state() != 0; }
+
+ protected:
+  LightOutput *output_;
+  LightColorValues start_values_;
+  bool in_transition_{false};
+  uint32_t start_time_{0};
+  uint32_t length_ms_{0};
+};
+
+}  // namespace light
+}  // namespace esphome
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "esphome/core/entity_base.h"
+
+namespace esphome {
+namespace number {
+
+class NumberTraits {
+ public:
+  void set_min_value(float min_value) { this->min_value_ = min_value; }
+  float get_min_value() const { return this->min_value_; }
+  void set_max_value(float max_value) { this->max_value_ = max_value; }
+  float get_max_value() const { return this->max_value_; }
+  void set_step(float step) { this->step_ = step; }
+  float get_step() const { return this->step_; }
+
+ protected:
+  float min_value_{0};
+  float max_value_{100};
+  float step_{1};
+};
+
+class Number : public EntityBase {
+ public:
+  float state{0};
+  NumberTraits traits;
+
+  void publish_state(float state) { this->state = state; }
+
+ protected:
+  virtual void control(float value) = 0;
+};
+
+}  // namespace number
+}  // namespace esphome
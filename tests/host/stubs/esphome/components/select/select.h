@@ -0,0 +1,44 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "esphome/core/entity_base.h"
+
+namespace esphome {
+namespace select {
+
+class SelectTraits {
+ public:
+  void set_options(std::vector< std::string > options) { this->options_ = std::move(options); }
+  const std::vector< std::string > &get_options() const { return this->options_; }
+
+ protected:
+  std::vector< std::string > options_;
+};
+
+class Select : public EntityBase {
+ public:
+  std::string state;
+  SelectTraits traits;
+
+  void publish_state(const std::string &state) {
+    auto &options = this->traits.get_options();
+    auto it = std::find(options.begin(), options.end(), state);
+    if (it == options.end()) return;
+    this->state = state;
+    for (auto &callback : this->state_callbacks_) {
+      callback(state, it - options.begin());
+    }
+  }
+  void add_on_state_callback(std::function< void(std::string, size_t) > &&callback) {
+    this->state_callbacks_.push_back(std::move(callback));
+  }
+
+ protected:
+  virtual void control(const std::string &value) = 0;
+  std::vector< std::function< void(std::string, size_t) > > state_callbacks_;
+};
+
+}  // namespace select
+}  // namespace esphome
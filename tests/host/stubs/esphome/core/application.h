@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+#include "esphome/core/component.h"
+#include "esphome/components/select/select.h"
+#include "esphome/components/number/number.h"
+
+namespace esphome {
+
+class Application {
+ public:
+  void register_select(select::Select *obj) { this->selects_.push_back(obj); }
+  void register_number(number::Number *obj) { this->numbers_.push_back(obj); }
+  void feed_wdt() { this->nb_wdt_feeds_++; }
+  uint32_t get_nb_wdt_feeds() const { return this->nb_wdt_feeds_; }
+
+ protected:
+  std::vector< select::Select * > selects_;
+  std::vector< number::Number * > numbers_;
+  uint32_t nb_wdt_feeds_{0};
+};
+
+extern Application App;
+
+}  // namespace esphome
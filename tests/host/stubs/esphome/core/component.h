@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace esphome {
+
+namespace setup_priority {
+extern const float BUS;
+extern const float IO;
+extern const float HARDWARE;
+extern const float DATA;
+extern const float PROCESSOR;
+extern const float BLUETOOTH;
+extern const float AFTER_BLUETOOTH;
+extern const float WIFI;
+extern const float LATE;
+}  // namespace setup_priority
+
+class Component {
+ public:
+  virtual ~Component() = default;
+  virtual void setup() {}
+  virtual void loop() {}
+  virtual void dump_config() {}
+  virtual float get_setup_priority() const;
+  float get_actual_setup_priority() const;
+  void set_setup_priority(float priority);
+  void set_component_source(const char *source) { this->component_source_ = source; }
+
+ protected:
+  const char *component_source_{nullptr};
+  bool has_setup_priority_override_{false};
+  float setup_priority_override_{0};
+};
+
+class PollingComponent : public Component {
+ public:
+  PollingComponent() {}
+  PollingComponent(uint32_t update_interval) : update_interval_(update_interval) {}
+  virtual void update() = 0;
+  void set_update_interval(uint32_t update_interval) { this->update_interval_ = update_interval; }
+  uint32_t get_update_interval() const { return this->update_interval_; }
+
+ protected:
+  uint32_t update_interval_{60000};
+};
+
+}  // namespace esphome
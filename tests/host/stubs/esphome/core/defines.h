@@ -0,0 +1,5 @@
+#pragma once
+
+// Host build: only the features used by the ble_adv_controller sources
+#define USE_ESP32
+#define USE_ESP32_BLE_CLIENT
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "esphome/core/helpers.h"
+#include "esphome/core/string_ref.h"
+
+namespace esphome {
+
+enum EntityCategory : uint8_t {
+  ENTITY_CATEGORY_NONE = 0,
+  ENTITY_CATEGORY_CONFIG = 1,
+  ENTITY_CATEGORY_DIAGNOSTIC = 2,
+};
+
+class EntityBase {
+ public:
+  const StringRef &get_name() const { return this->name_; }
+  void set_name(const char *name) { this->name_ = StringRef(name); }
+  std::string get_object_id() const { return this->object_id_c_str_; }
+  void set_object_id(const char *object_id) { this->object_id_c_str_ = object_id; }
+  uint32_t get_object_id_hash() { return fnv1_hash(this->object_id_c_str_); }
+  EntityCategory get_entity_category() const { return this->entity_category_; }
+  void set_entity_category(EntityCategory entity_category) { this->entity_category_ = entity_category; }
+
+ protected:
+  StringRef name_;
+  const char *object_id_c_str_{""};
+  EntityCategory entity_category_{ENTITY_CATEGORY_NONE};
+};
+
+}  // namespace esphome
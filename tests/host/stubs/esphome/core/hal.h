@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+
+namespace esphome {
+// Host build: virtual time of the simulation, see harness/sim.h
+uint32_t millis();
+uint32_t micros();
+}  // namespace esphome
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace esphome {
+
+std::string format_hex_pretty(const uint8_t *data, size_t length);
+uint32_t fnv1_hash(const std::string &str);
+
+template<typename T> class Parented {
+ public:
+  Parented() {}
+  Parented(T *parent) : parent_(parent) {}
+  T *get_parent() const { return this->parent_; }
+  void set_parent(T *parent) { this->parent_ = parent; }
+
+ protected:
+  T *parent_{nullptr};
+};
+
+// Same as ESPHome: the main loop runs without delay as long as one requester is started
+class HighFrequencyLoopRequester {
+ public:
+  void start();
+  void stop();
+  static bool is_high_frequency();
+
+ protected:
+  bool started_{false};
+  static uint8_t num_requests;
+};
+
+}  // namespace esphome
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdio>
+
+// Host build of the ESPHome log macros: compiled at DEBUG level as on the device,
+// printed on stderr only up to the runtime level of the test (warnings by default).
+#define ESPHOME_LOG_LEVEL_NONE 0
+#define ESPHOME_LOG_LEVEL_ERROR 1
+#define ESPHOME_LOG_LEVEL_WARN 2
+#define ESPHOME_LOG_LEVEL_INFO 3
+#define ESPHOME_LOG_LEVEL_CONFIG 4
+#define ESPHOME_LOG_LEVEL_DEBUG 5
+#define ESPHOME_LOG_LEVEL_VERBOSE 6
+#define ESPHOME_LOG_LEVEL_VERY_VERBOSE 7
+
+#ifndef ESPHOME_LOG_LEVEL
+#define ESPHOME_LOG_LEVEL ESPHOME_LOG_LEVEL_DEBUG
+#endif
+
+namespace esphome {
+// runtime level, as the logger component level
+extern int host_log_level;
+void host_log(int level, const char *tag, const char *format, ...);
+}  // namespace esphome
+
+#define ESPHOME_HOST_LOG(level, tag, ...) \
+  do { if ((level) <= esphome::host_log_level) esphome::host_log(level, tag, __VA_ARGS__); } while (0)
+
+#define ESP_LOGE(tag, ...) ESPHOME_HOST_LOG(ESPHOME_LOG_LEVEL_ERROR, tag, __VA_ARGS__)
+#define ESP_LOGW(tag, ...) ESPHOME_HOST_LOG(ESPHOME_LOG_LEVEL_WARN, tag, __VA_ARGS__)
+#define ESP_LOGI(tag, ...) ESPHOME_HOST_LOG(ESPHOME_LOG_LEVEL_INFO, tag, __VA_ARGS__)
+#define ESP_LOGCONFIG(tag, ...) ESPHOME_HOST_LOG(ESPHOME_LOG_LEVEL_CONFIG, tag, __VA_ARGS__)
+#define ESP_LOGD(tag, ...) ESPHOME_HOST_LOG(ESPHOME_LOG_LEVEL_DEBUG, tag, __VA_ARGS__)
+#if ESPHOME_LOG_LEVEL >= ESPHOME_LOG_LEVEL_VERBOSE
+#define ESP_LOGV(tag, ...) ESPHOME_HOST_LOG(ESPHOME_LOG_LEVEL_VERBOSE, tag, __VA_ARGS__)
+#else
+#define ESP_LOGV(tag, ...) do { } while (0)
+#endif
+#define ESP_LOGVV(tag, ...) do { } while (0)
+
+#define ESP_ERROR_CHECK_WITHOUT_ABORT(x) (x)
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <vector>
+
+namespace esphome {
+
+// Host build: preferences kept in memory for the duration of the test
+class ESPPreferenceObject {
+ public:
+  ESPPreferenceObject(std::vector< uint8_t > *data = nullptr) : data_(data) {}
+  template<typename T> bool save(const T *src) {
+    if (this->data_ == nullptr) return false;
+    this->data_->assign((const uint8_t *) src, (const uint8_t *) src + sizeof(T));
+    return true;
+  }
+  template<typename T> bool load(T *dest) {
+    if ((this->data_ == nullptr) || (this->data_->size() != sizeof(T))) return false;
+    memcpy(dest, this->data_->data(), sizeof(T));
+    return true;
+  }
+
+ protected:
+  std::vector< uint8_t > *data_;
+};
+
+class ESPPreferences {
+ public:
+  template<typename T> ESPPreferenceObject make_preference(uint32_t type, bool in_flash = false) {
+    return ESPPreferenceObject(&this->data_[type]);
+  }
+
+ protected:
+  std::map< uint32_t, std::vector< uint8_t > > data_;
+};
+
+extern ESPPreferences *global_preferences;
+
+}  // namespace esphome
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+
+namespace esphome {
+
+class StringRef {
+ public:
+  StringRef() : str_("") {}
+  StringRef(const char *s) : str_(s) {}
+  const char *c_str() const { return this->str_; }
+  size_t size() const { return strlen(this->str_); }
+  operator std::string() const { return std::string(this->str_); }
+
+ protected:
+  const char *str_;
+};
+
+}  // namespace esphome
@@ -0,0 +1,200 @@
+// Scenarios over the Advertiser, run in virtual time on a FakeGap, one per run:
+//   test_advertiser <scenario>
+
+#include "harness/encoders.h"
+#include "harness/fake_gap.h"
+#include "harness/sim.h"
+#include "harness/test.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace esphome::bleadvcontroller;
+using host::Sim;
+
+// Handler on a FakeGap with the encoders registered, controllers to be added before setup()
+struct Bench {
+  Bench(uint8_t nb_sets = 1): gap(nb_sets) {
+    this->handler = new BleAdvHandler();
+    this->handler->set_gap(&this->gap);
+    host::register_encoders(*this->handler);
+    this->sim.add_component(this->handler);
+  }
+
+  BleAdvController * add(const host::ControllerConfig & config) {
+    BleAdvController * controller = host::make_controller(*this->handler, config);
+    this->sim.add_component(controller);
+    return controller;
+  }
+
+  void enqueue(BleAdvController * controller, CommandType type, uint32_t at_ms, uint8_t arg = 0) {
+    this->sim.post_to_loop((uint64_t)at_ms * 1000, [controller, type, arg]() {
+      Command cmd(type);
+      cmd.args_[0] = arg;
+      CHECK(controller->enqueue(cmd));
+    });
+  }
+
+  Sim & sim{Sim::get()};
+  host::FakeGap gap;
+  BleAdvHandler * handler{nullptr};
+};
+
+// The window of the packet on air expires with another one waiting:
+// the set is switched to it within a few GAP latencies, not a main loop interval.
+static void switch_latency() {
+  Bench bench;
+  BleAdvController * first = bench.add({"first", "zhijia", "v2"});
+  BleAdvController * second = bench.add({"second", "zhijia", "v2"});
+  bench.sim.setup();
+  bench.enqueue(first, CommandType::LIGHT_ON, 0);
+  bench.enqueue(second, CommandType::LIGHT_ON, 0);
+  bench.sim.run_for_ms(1000);
+
+  auto & airs = bench.gap.get_airs();
+  if (!CHECK(airs.size() >= 2)) return;
+  uint64_t switch_us = airs[1].start_us_ - airs[0].end_us_;
+  printf("switch: %d us\n", (int)switch_us);
+  // stop completion, configuration and start: 3 GAP latencies at most, with the loop at full speed
+  CHECK(switch_us <= 3 * bench.gap.latency_us_);
+  // the stop requested by the main loop, not by the timer task at the window expiry
+  CHECK(bench.gap.get_nb_timer_task_requests() == 0);
+  CHECK(bench.gap.get_nb_errors() == 0);
+}
+
+// Commands of a controller following each other, with its room in the Advertiser queue for a single variant:
+// the next one is added while the current one is still on air, none is dropped.
+static void back_to_back() {
+  Bench bench;
+  host::ControllerConfig config{"single", "zhijia", "v2"};
+  BleAdvController * controller = bench.add(config);
+  bench.sim.setup();
+  const CommandType types[] = {CommandType::LIGHT_ON, CommandType::LIGHT_DIM, CommandType::LIGHT_CCT, CommandType::LIGHT_OFF};
+  for (size_t i = 0; i < 4; ++i) {
+    bench.enqueue(controller, types[i], 10 * i, 10 * i);
+  }
+  bench.sim.run_for_ms(5000);
+
+  // each command advertised in turn, the last one being the final state
+  std::vector< uint8_t > on_air;
+  BleAdvEncoder * encoder = bench.handler->get_encoder(config.encoding, config.variant);
+  for (auto & air : bench.gap.get_airs()) {
+    BleAdvParam param;
+    param.from_raw(air.buf_, air.len_);
+    Command cmd;
+    ControllerParam_t cont;
+    if (CHECK(encoder->decode(param, cmd, cont)) && (on_air.empty() || (on_air.back() != cmd.cmd_))) {
+      on_air.push_back(cmd.cmd_);
+    }
+  }
+  printf("%d commands on air, %d dropped\n", (int)on_air.size(), bench.handler->get_nb_dropped());
+  CHECK(on_air.size() == 4);
+  CHECK(bench.handler->get_nb_dropped() == 0);
+  CHECK(controller->get_queue_depth() == 0);
+  CHECK(bench.gap.get_nb_errors() == 0);
+}
+
+// Transition streaming on a controller advertising the packets of all the variants in sequence, longer than its
+// duration: the next intermediate state is only ready once the whole sequence of the last one was advertised.
+static void stream_ready() {
+  Bench bench;
+  host::ControllerConfig config{"all", "fanlamp_pro", "All"};
+  config.duration = 200;
+  config.seq_duration = 100;
+  // 'All' only selectable with the dynamic configuration shown
+  config.show_config = true;
+  BleAdvController * controller = bench.add(config);
+  bench.sim.setup();
+  // frame sent by the light entity at once
+  uint32_t frame_time = bench.sim.now_ms();
+  bench.enqueue(controller, CommandType::LIGHT_WCOLOR, 0, 10);
+  bench.sim.run_for_ms(50);
+  if (!CHECK(controller->get_queue_depth() == 0)) return;
+
+  // one packet per variant of the encoding, for seq_duration each
+  uint32_t seq_len = 3 * config.seq_duration;
+  bench.sim.run_for_ms(seq_len - 60);
+  printf("not ready after %d ms\n", bench.sim.now_ms() - frame_time);
+  CHECK(!controller->is_stream_ready(frame_time, 1));
+  bench.sim.run_for_ms(20);
+  CHECK(controller->is_stream_ready(frame_time, 1));
+  // two commands in the last frame
+  CHECK(!controller->is_stream_ready(frame_time, 2));
+}
+
+// Adaptive duration on a burst of commands: each one advertised for less than the duration while others are waiting,
+// down to the floor of the encoder with the backlog full, and back to the duration as the queue drains.
+static void adaptive_duration() {
+  Bench bench;
+  host::ControllerConfig config{"burst", "fanlamp_pro", "v3"};
+  config.duration = 300;
+  config.adaptive_duration = true;
+  config.adaptive_backlog = 4;
+  BleAdvController * controller = bench.add(config);
+  bench.sim.setup();
+  // commands of distinct types, never superseded by each other
+  const size_t NB_CMDS = 8;
+  std::vector< CommandType > types;
+  std::vector< uint8_t > keys;
+  for (uint8_t type = CommandType::PAIR; (type < MAX_COMMAND_TYPE) && (types.size() < NB_CMDS); ++type) {
+    uint8_t key = BleAdvController::get_coalesce_key((CommandType)type);
+    if ((type == CommandType::CUSTOM) || !controller->is_supported(Command((CommandType)type))) continue;
+    if ((key != CommandType::NOCMD) && (std::find(keys.begin(), keys.end(), key) != keys.end())) continue;
+    types.push_back((CommandType)type);
+    keys.push_back(key);
+  }
+  if (!CHECK(types.size() == NB_CMDS)) return;
+  bench.sim.post_to_loop(0, [controller, types]() {
+    for (auto type : types) {
+      Command cmd(type);
+      CHECK(controller->enqueue(cmd));
+    }
+  });
+  bench.sim.run_for_ms(10000);
+
+  // start of each command on air
+  std::vector< uint64_t > starts;
+  uint8_t last_cmd = 0xFF;
+  BleAdvEncoder * encoder = bench.handler->get_encoder(config.encoding, config.variant);
+  for (auto & air : bench.gap.get_airs()) {
+    BleAdvParam param;
+    param.from_raw(air.buf_, air.len_);
+    Command cmd;
+    ControllerParam_t cont;
+    if (CHECK(encoder->decode(param, cmd, cont)) && (cmd.cmd_ != last_cmd)) {
+      starts.push_back(air.start_us_);
+      last_cmd = cmd.cmd_;
+    }
+  }
+  if (!CHECK(starts.size() == NB_CMDS)) return;
+  uint32_t floor = encoder->get_duration_floor();
+  std::vector< uint32_t > durations;
+  for (size_t i = 1; i < NB_CMDS; ++i) {
+    durations.push_back((starts[i] - starts[i - 1]) / 1000);
+    printf("command %d: %d ms, %d waiting\n", (int)i, durations.back(), (int)(NB_CMDS - i));
+  }
+  // backlog full while 4 more commands are waiting after the next one: the floor, plus a main loop interval at most
+  for (size_t i = 0; i < NB_CMDS - 5; ++i) {
+    CHECK((durations[i] >= floor) && (durations[i] < floor + 20));
+  }
+  // then reduced less and less, the last one with none waiting after it for the full duration
+  for (size_t i = NB_CMDS - 5; i < durations.size(); ++i) {
+    CHECK(durations[i] > durations[i - 1]);
+  }
+  CHECK(durations.back() >= (uint32_t)config.duration);
+  CHECK(controller->get_tx_duration() == (uint32_t)config.duration);
+  CHECK(bench.handler->get_nb_dropped() == 0);
+}
+
+int main(int argc, char ** argv) {
+  const char * scenario = (argc > 1) ? argv[1] : "";
+  if (strcmp(scenario, "switch_latency") == 0) switch_latency();
+  else if (strcmp(scenario, "back_to_back") == 0) back_to_back();
+  else if (strcmp(scenario, "stream_ready") == 0) stream_ready();
+  else if (strcmp(scenario, "adaptive_duration") == 0) adaptive_duration();
+  else {
+    fprintf(stderr, "unknown scenario '%s'\n", scenario);
+    return 2;
+  }
+  return host::test_result(scenario);
+}
@@ -0,0 +1,159 @@
+// Golden vectors of the encoders: each packet of the corpus is decoded by its encoder / variant to the expected
+// parameters, re-encoded and compared byte for byte, then random round trips are run over all encoders.
+//   test_corpus <corpus file> [nb_loops] [seed]
+//   test_corpus --generate: print the generated vectors of the corpus, from the current encoders
+// Corpus lines, '#' starting a comment:
+//   version <n>
+//   <encoding> <variant> <id> <index> <tx> <cmd> <arg0> <arg1> <arg2> <arg3> <raw>
+//   none <raw>: a packet that no encoder decodes
+
+#include "harness/encoders.h"
+#include "harness/test.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace esphome::bleadvcontroller;
+
+static constexpr int CORPUS_VERSION = 1;
+
+// access to the re-encode check of identify_param()
+struct CorpusHandler: public BleAdvHandler {
+  using BleAdvHandler::check_reencode;
+};
+
+static bool parse_raw(const std::string & raw, BleAdvParam & param) {
+  uint8_t buf[MAX_PACKET_LEN];
+  size_t len = 0;
+  for (size_t i = 0; i + 1 < raw.size(); i += 3) {
+    if (len == MAX_PACKET_LEN) return false;
+    buf[len++] = strtol(raw.substr(i, 2).c_str(), nullptr, 16);
+  }
+  param.from_raw(buf, len);
+  return len > 0;
+}
+
+static void check_vector(CorpusHandler & handler, int line_nb, std::istringstream & line, const std::string & encoding) {
+  std::string variant, raw;
+  uint32_t id, index, tx, cmd, args[4];
+  line >> variant >> std::hex >> id >> std::dec >> index >> tx >> std::hex >> cmd >> std::dec;
+  line >> args[0] >> args[1] >> args[2] >> args[3] >> raw;
+  BleAdvParam param;
+  if (!CHECK(!line.fail() && parse_raw(raw, param))) {
+    fprintf(stderr, "line %d: invalid vector\n", line_nb);
+    return;
+  }
+  BleAdvEncoder * encoder = handler.get_encoder(encoding, variant);
+  if (!CHECK(encoder != nullptr)) {
+    fprintf(stderr, "line %d: unknown encoder %s - %s\n", line_nb, encoding.c_str(), variant.c_str());
+    return;
+  }
+
+  Command dec_cmd(CommandType::CUSTOM);
+  ControllerParam_t dec_cont;
+  bool ok = (param.get_data_len() == encoder->get_data_len()) && encoder->is_header(param.get_const_data_buf())
+            && encoder->decode(param, dec_cmd, dec_cont);
+  ok = ok && (dec_cont.id_ == id) && (dec_cont.index_ == index) && (dec_cont.tx_count_ == tx) && (dec_cmd.cmd_ == cmd);
+  for (size_t i = 0; i < 4; ++i) {
+    ok = ok && (dec_cmd.args_[i] == args[i]);
+  }
+  ok = ok && handler.check_reencode(encoder, param, dec_cmd, dec_cont);
+  if (!CHECK(ok)) {
+    fprintf(stderr, "line %d: %s - decoded id 0x%X, index %d, tx %d, cmd 0x%02X, args [%d,%d,%d,%d]\n", line_nb,
+            encoder->get_id().c_str(), dec_cont.id_, dec_cont.index_, dec_cont.tx_count_, dec_cmd.cmd_,
+            dec_cmd.args_[0], dec_cmd.args_[1], dec_cmd.args_[2], dec_cmd.args_[3]);
+  }
+  // as captured, whatever the AD flag and data type
+  CHECK(handler.identify_param(param, true));
+}
+
+static void check_corpus(CorpusHandler & handler, const char * path) {
+  std::ifstream file(path);
+  if (!CHECK(file.is_open())) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return;
+  }
+  int version = 0;
+  int nb_vectors = 0;
+  std::string text;
+  for (int line_nb = 1; std::getline(file, text); ++line_nb) {
+    std::istringstream line(text.substr(0, text.find('#')));
+    std::string first;
+    if (!(line >> first)) continue;
+    if (first == "version") {
+      line >> version;
+      continue;
+    }
+    if (!CHECK(version == CORPUS_VERSION)) {
+      fprintf(stderr, "line %d: corpus version %d, expected %d\n", line_nb, version, CORPUS_VERSION);
+      return;
+    }
+    nb_vectors++;
+    if (first == "none") {
+      std::string raw;
+      line >> raw;
+      BleAdvParam param;
+      CHECK(parse_raw(raw, param) && !handler.identify_param(param, true));
+    } else {
+      check_vector(handler, line_nb, line, first);
+    }
+  }
+  printf("%d vectors checked from %s\n", nb_vectors, path);
+  CHECK(nb_vectors > 0);
+}
+
+// the same commands encoded by each encoder for a fixed controller, the seeds of the encoders being drawn from rand()
+static void generate(CorpusHandler & handler) {
+  srand(1);
+  const CommandType types[] = {CommandType::PAIR, CommandType::LIGHT_ON, CommandType::LIGHT_OFF,
+                               CommandType::LIGHT_WCOLOR, CommandType::LIGHT_DIM, CommandType::FAN_ONOFF_SPEED};
+  for (uint8_t handle = 0; BleAdvEncoder * encoder = handler.get_encoder(handle); ++handle) {
+    if (encoder->get_data_len() == 0) continue;
+    for (CommandType type : types) {
+      Command cmd(type);
+      if (!encoder->is_supported(cmd)) continue;
+      cmd.args_[0] = (type == CommandType::FAN_ONOFF_SPEED) ? 2 : 100;
+      cmd.args_[1] = (type == CommandType::FAN_ONOFF_SPEED) ? 6 : 50;
+      ControllerParam_t cont;
+      cont.id_ = 0x5A3F;
+      cont.index_ = 1;
+      cont.tx_count_ = 0x20;
+      std::vector< BleAdvParam > params;
+      encoder->encode(params, cmd, cont);
+      for (auto & param : params) {
+        Command dec_cmd(CommandType::CUSTOM);
+        ControllerParam_t dec_cont;
+        encoder->decode(param, dec_cmd, dec_cont);
+        std::string raw = esphome::format_hex_pretty(param.get_full_buf(), param.get_full_len());
+        printf("%s %s 0x%X %d %d 0x%02X %d %d %d %d %s\n", encoder->get_encoding().c_str(), encoder->get_variant().c_str(),
+               dec_cont.id_, dec_cont.index_, dec_cont.tx_count_, dec_cmd.cmd_, dec_cmd.args_[0], dec_cmd.args_[1],
+               dec_cmd.args_[2], dec_cmd.args_[3], raw.substr(0, raw.find(' ')).c_str());
+      }
+    }
+  }
+}
+
+int main(int argc, char ** argv) {
+  esphome::host_log_level = ESPHOME_LOG_LEVEL_WARN;
+  CorpusHandler handler;
+  host::register_encoders(handler);
+  if ((argc > 1) && (strcmp(argv[1], "--generate") == 0)) {
+    generate(handler);
+    return 0;
+  }
+  if (argc < 2) {
+    fprintf(stderr, "usage: test_corpus <corpus file> [nb_loops] [seed]\n");
+    return 2;
+  }
+  check_corpus(handler, argv[1]);
+
+  uint32_t nb_loops = (argc > 2) ? atoi(argv[2]) : 100;
+  uint32_t seed = (argc > 3) ? atoi(argv[3]) : 1;
+  printf("random round trips: %d per command type, seed %d\n", nb_loops, seed);
+  srand(seed);
+  CHECK(handler.check_encoders(nb_loops) == 0);
+  return host::test_result("corpus");
+}
@@ -0,0 +1,45 @@
+// CRC16 from the tables against the bit by bit esphome helpers previously used, on random inputs and seeds:
+// the primitives and the crc16 of the Zhijia and FanLamp encoders. Then time of both per packet.
+// Built with the full tables and with USE_BLE_ADV_CRC16_NIBBLE.
+//   test_crc16 [nb_loops]
+
+#include "harness/primitives.h"
+#include "harness/test.h"
+
+#include <cstdlib>
+
+using host::Primitives;
+
+int main(int argc, char ** argv) {
+  uint32_t nb_loops = (argc > 1) ? atoi(argv[1]) : 100000;
+  Primitives prim;
+  host::ZhijiaPrimitives zhijia;
+  host::FanLampPrimitives fanlamp;
+  srand(1);
+
+  for (uint32_t i = 0; i < 10000; ++i) {
+    uint8_t buf[64];
+    for (auto & b : buf) b = rand() & 0xFF;
+    size_t len = rand() % (sizeof(buf) + 1);
+    uint16_t seed = rand() & 0xFFFF;
+    bool ok = (prim.crc16_8408(buf, len, seed) == Primitives::ref_crc16(buf, len, seed, 0x8408, false, false));
+    ok = ok && (prim.crc16_1021(buf, len, seed) == Primitives::ref_crc16be(buf, len, seed, 0x1021, false, false));
+    ok = ok && (zhijia.crc16(buf, len, seed) == Primitives::ref_crc16(buf, len, seed, 0x8408, true, true));
+    ok = ok && (fanlamp.crc16(buf, len, seed) == Primitives::ref_crc16be(buf, len, seed, 0x1021, false, false));
+    if (!CHECK(ok)) {
+      fprintf(stderr, "len %d, seed 0x%04X: crc differs\n", (int)len, seed);
+      break;
+    }
+  }
+
+  // static for the timed loops not to be optimized out
+  static uint8_t buf[esphome::bleadvcontroller::MAX_PACKET_LEN] = {0};
+  static uint16_t crc = 0;
+  double ref_ns = host::time_ns(nb_loops, [&](uint32_t) { crc = Primitives::ref_crc16(buf, sizeof(buf), crc, 0x8408, false, false); });
+  double table_ns = host::time_ns(nb_loops, [&](uint32_t) { crc = prim.crc16_8408(buf, sizeof(buf), crc); });
+  printf("crc16_8408, %d bytes: bit by bit %.1f ns, tables %.1f ns\n", (int)sizeof(buf), ref_ns, table_ns);
+  ref_ns = host::time_ns(nb_loops, [&](uint32_t) { crc = Primitives::ref_crc16be(buf, sizeof(buf), crc, 0x1021, false, false); });
+  table_ns = host::time_ns(nb_loops, [&](uint32_t) { crc = prim.crc16_1021(buf, sizeof(buf), crc); });
+  printf("crc16_1021, %d bytes: bit by bit %.1f ns, tables %.1f ns\n", (int)sizeof(buf), ref_ns, table_ns);
+  return host::test_result("crc16");
+}
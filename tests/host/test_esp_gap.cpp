@@ -0,0 +1,54 @@
+// The Advertiser on its ESP-IDF shim, BleAdvEspExtGap or BleAdvEspLegacyGap depending on CONFIG_BT_BLE_50_FEATURES_SUPPORTED,
+// over the host BLE stack enabled by esp32_ble after the setup of the components, as ESPHome does.
+
+#include "harness/bt_stack.h"
+#include "harness/encoders.h"
+#include "harness/sim.h"
+#include "harness/test.h"
+
+using namespace esphome::bleadvcontroller;
+using host::BtStack;
+using host::Sim;
+
+int main(int argc, char ** argv) {
+  BtStack & stack = BtStack::get();
+#ifdef CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+  // a controller with less sets than the Advertiser can use
+  stack.nb_sets_ = MAX_ADV_SETS - 1;
+  const uint8_t expected_sets = MAX_ADV_SETS - 1;
+#else
+  const uint8_t expected_sets = 1;
+#endif
+
+  Sim & sim = Sim::get();
+  auto * handler = new BleAdvHandler();
+  host::register_encoders(*handler);
+  sim.add_component(handler);
+  std::vector< BleAdvController * > controllers;
+  for (const char * name : {"kitchen", "living", "bedroom", "hall", "desk"}) {
+    controllers.push_back(host::make_controller(*handler, {name, "zhijia", "v2"}));
+    sim.add_component(controllers.back());
+  }
+  sim.setup();
+  for (auto * controller : controllers) {
+    sim.post_to_loop(0, [controller]() {
+      Command cmd(CommandType::LIGHT_ON);
+      CHECK(controller->enqueue(cmd));
+    });
+  }
+  // advertised at most max_duration
+  sim.run_for_ms(5000);
+
+  printf("%d sets, %d starts, max %d sets advertising, %d requests refused\n",
+          handler->get_nb_sets(), stack.get_nb_starts(), stack.get_max_advertising(), stack.get_nb_refused());
+  // the GAP only used once the BLE stack enabled, with all the sets accepted by the controller
+  CHECK(stack.get_nb_refused() == 0);
+  CHECK(handler->get_nb_sets() == expected_sets);
+  CHECK(stack.get_max_advertising() == expected_sets);
+  CHECK(stack.get_nb_starts() >= controllers.size());
+  CHECK(handler->get_nb_dropped() == 0);
+  for (uint8_t set = 0; set < BtStack::MAX_INSTANCES; ++set) {
+    CHECK(!stack.is_advertising(set));
+  }
+  return host::test_result("esp_gap");
+}
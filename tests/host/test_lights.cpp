@@ -0,0 +1,232 @@
+// Slider drags on lamps through the light entities, run in virtual time on a FakeGap:
+// each lamp a BleAdvLight with transition streaming, its LightState written at each main loop iteration
+// during the transitions, as by ESPHome, several of them dragged at the same time.
+//   test_lights [nb_lamps] [--timeline]
+// Prints per lamp the write_state() calls, the commands issued and coalesced, the packets on air
+// and the latency from the end of its last transition to its final state on air.
+
+#include "harness/encoders.h"
+#include "harness/fake_gap.h"
+#include "harness/sim.h"
+#include "harness/test.h"
+
+#include "light/ble_adv_light.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+using namespace esphome::bleadvcontroller;
+using esphome::light::LightColorValues;
+using esphome::light::LightState;
+using host::Sim;
+
+// cold / warm white temperatures of the lamps, in mireds
+static constexpr float COLD_MIREDS = 153;
+static constexpr float WARM_MIREDS = 370;
+// transition length of the light calls, the ESPHome default one
+static constexpr uint32_t TRANSITION_MS = 1000;
+
+// counting the write_state() calls and the commands issued by the light
+struct CountingLight: public BleAdvLight {
+  void write_state(LightState * state) override {
+    this->nb_writes_++;
+    size_t before = this->get_parent()->get_queue_depth() + this->get_parent()->get_nb_coalesced();
+    BleAdvLight::write_state(state);
+    this->nb_commands_ += this->get_parent()->get_queue_depth() + this->get_parent()->get_nb_coalesced() - before;
+  }
+  uint32_t nb_writes_{0};
+  uint32_t nb_commands_{0};
+};
+
+struct Lamp {
+  host::ControllerConfig config;
+  BleAdvController * controller{nullptr};
+  BleAdvEncoder * encoder{nullptr};
+  CountingLight * light{nullptr};
+  LightState * state{nullptr};
+  uint32_t air_id{0};
+  uint32_t nb_air{0};
+  Command last_on_air;
+  // end of the last transition, and first time on air of the final state after it
+  uint64_t final_us{0};
+  uint64_t final_air_us{0};
+  Command final_cmd;
+};
+
+// target values as set by a light call in cold / warm white color mode
+static LightColorValues target(float state, float brightness, float mireds) {
+  LightColorValues values;
+  values.set_state(state);
+  values.set_brightness(brightness);
+  values.set_color_temperature(mireds);
+  float cold = (WARM_MIREDS - mireds) / (WARM_MIREDS - COLD_MIREDS);
+  values.set_cold_white(cold);
+  values.set_warm_white(1.f - cold);
+  return values;
+}
+
+// decoded command and controller id of a packet, false if not decoded by the encoder
+static bool decode(BleAdvEncoder * encoder, const uint8_t * buf, uint8_t len, Command & cmd, uint32_t & id) {
+  BleAdvParam param;
+  param.from_raw(buf, len);
+  ControllerParam_t cont;
+  cmd = Command(CommandType::CUSTOM);
+  if (!encoder->decode(param, cmd, cont)) return false;
+  id = cont.id_;
+  return true;
+}
+
+// command as decoded from the air once encoded for the controller
+static bool on_air(Lamp & lamp, Command cmd, Command & decoded, uint32_t & id) {
+  std::vector< BleAdvParam > params;
+  ControllerParam_t cont;
+  cont.id_ = esphome::fnv1_hash(lamp.config.name);
+  lamp.encoder->encode(params, cmd, cont);
+  return !params.empty() && decode(lamp.encoder, params.back().get_full_buf(), params.back().get_full_len(), decoded, id);
+}
+
+int main(int argc, char ** argv) {
+  size_t nb_lamps = 20;
+  bool timeline = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--timeline") == 0) timeline = true;
+    else nb_lamps = atoi(argv[i]);
+  }
+  srand(1);
+
+  // the most common encodings, zhijia v2 not supporting LIGHT_WCOLOR: CCT and DIM commands sent instead
+  static const char * ENCODINGS[][2] = {{"zhijia", "v2"}, {"fanlamp_pro", "v3"}, {"lampsmart_pro", "v3"}};
+  std::vector< std::string > names(nb_lamps);
+  std::vector< Lamp > lamps(nb_lamps);
+  for (size_t i = 0; i < nb_lamps; ++i) {
+    names[i] = "lamp" + std::to_string(i);
+    lamps[i].config = {names[i].c_str(), ENCODINGS[i % 3][0], ENCODINGS[i % 3][1]};
+  }
+
+  Sim & sim = Sim::get();
+  auto * handler = new BleAdvHandler();
+  host::FakeGap gap(1);
+  handler->set_gap(&gap);
+  handler->set_scheduler(SchedulerPolicy::WEIGHTED_FAIR);
+  host::register_encoders(*handler);
+  sim.add_component(handler);
+  for (auto & lamp : lamps) {
+    lamp.controller = host::make_controller(*handler, lamp.config);
+    lamp.encoder = handler->get_encoder(lamp.config.encoding, lamp.config.variant);
+    sim.add_component(lamp.controller);
+    // as generated by the python codegen for the light platform
+    lamp.light = new CountingLight();
+    lamp.light->set_parent(lamp.controller);
+    lamp.light->set_traits(COLD_MIREDS, WARM_MIREDS);
+    lamp.light->set_constant_brightness(false);
+    lamp.light->set_min_brightness(0, 0, 100, 1);
+    lamp.light->set_split_dim_cct(false);
+    lamp.light->set_transition_streaming(true);
+    sim.add_component(lamp.light);
+    lamp.state = new LightState(lamp.light);
+    lamp.state->set_name(lamp.config.name);
+    sim.add_component(lamp.state);
+  }
+  sim.setup();
+  for (auto & lamp : lamps) {
+    Command dec;
+    CHECK(on_air(lamp, Command(CommandType::LIGHT_ON), dec, lamp.air_id));
+  }
+  uint64_t start_us = sim.now_us();
+
+  // each lamp switched on, then its brightness and color temperature sliders dragged: a light call every 250 ms,
+  // each one starting a transition from the current values. A lamp out of 4 switched off at the end.
+  uint32_t nb_calls = 0;
+  for (size_t i = 0; i < nb_lamps; ++i) {
+    Lamp * lamp = &lamps[i];
+    uint32_t offset_ms = 10 * i;
+    sim.post_to_loop((uint64_t)offset_ms * 1000, [lamp]() { lamp->state->start_transition(target(1, 0.5, 250), 0); });
+    float brightness = 0.5;
+    float mireds = 250;
+    uint32_t t = 0;
+    for (t = 200; t < 2700; t += 250) {
+      brightness = 0.1f + (rand() % 90) / 100.f;
+      mireds = COLD_MIREDS + rand() % (uint32_t)(WARM_MIREDS - COLD_MIREDS);
+      LightColorValues values = target(1, brightness, mireds);
+      sim.post_to_loop((uint64_t)(offset_ms + t) * 1000, [lamp, values]() { lamp->state->start_transition(values, TRANSITION_MS); });
+      nb_calls++;
+    }
+    // final state, as from the last light call
+    if (i % 4 == 3) {
+      sim.post_to_loop((uint64_t)(offset_ms + t + TRANSITION_MS) * 1000, [lamp]() { lamp->state->start_transition(target(0, 1, 250), 0); });
+      lamp->final_us = start_us + (uint64_t)(offset_ms + t + TRANSITION_MS) * 1000;
+      lamp->final_cmd = Command(CommandType::LIGHT_OFF);
+    } else {
+      lamp->final_us = start_us + (uint64_t)(offset_ms + t - 250 + TRANSITION_MS) * 1000;
+      LightColorValues values = target(1, brightness, mireds);
+      if (lamp->controller->is_supported(Command(CommandType::LIGHT_WCOLOR))) {
+        float cold = 0;
+        float warm = 0;
+        values.as_cwww(&cold, &warm);
+        lamp->final_cmd = Command(CommandType::LIGHT_WCOLOR);
+        lamp->final_cmd.args_[0] = (uint8_t)(cold * 255);
+        lamp->final_cmd.args_[1] = (uint8_t)(warm * 255);
+      } else {
+        lamp->final_cmd = Command(CommandType::LIGHT_DIM);
+        lamp->final_cmd.args_[0] = (uint8_t)(brightness * 255);
+      }
+    }
+  }
+
+  // the last final state up to 4 turns after the end of the drags, then kept on air its max duration
+  sim.run_for_ms(16000);
+
+  // attribute the packets on air to the lamps, and find the first air of their final state
+  for (auto & air : gap.get_airs()) {
+    for (auto & lamp : lamps) {
+      Command cmd;
+      uint32_t id = 0;
+      if (!decode(lamp.encoder, air.buf_, air.len_, cmd, id) || (id != lamp.air_id)) continue;
+      lamp.nb_air++;
+      lamp.last_on_air = cmd;
+      Command expected;
+      if ((lamp.final_air_us == 0) && (air.start_us_ >= lamp.final_us) && on_air(lamp, lamp.final_cmd, expected, id)
+          && (cmd.cmd_ == expected.cmd_) && std::equal(expected.args_, expected.args_ + 4, cmd.args_)) {
+        lamp.final_air_us = air.start_us_;
+      }
+      break;
+    }
+  }
+
+  if (timeline) {
+    host::print_timeline(stdout, *handler, gap);
+  }
+  printf("%d lamps, %d light calls: %d packets on air, %d GAP requests, %d main loop iterations\n",
+         (int)nb_lamps, nb_calls, (int)gap.get_airs().size(), gap.get_nb_requests(), sim.get_nb_loops());
+  printf("%-8s %-14s %7s %8s %9s %7s %9s\n", "lamp", "encoding", "writes", "commands", "coalesced", "on_air", "final_ms");
+  for (auto & lamp : lamps) {
+    uint32_t final_ms = (lamp.final_air_us > lamp.final_us) ? (lamp.final_air_us - lamp.final_us) / 1000 : 0;
+    std::string encoding = std::string(lamp.config.encoding) + " " + lamp.config.variant;
+    printf("%-8s %-14s %7d %8d %9d %7d %9d\n", lamp.config.name, encoding.c_str(), lamp.light->nb_writes_,
+           lamp.light->nb_commands_, lamp.controller->get_nb_coalesced(), lamp.nb_air, final_ms);
+
+    // intermediate states of the transitions streamed, only the ones the controller can advertise in time
+    CHECK(lamp.nb_air > 2);
+    CHECK(lamp.light->nb_commands_ < lamp.light->nb_writes_);
+    // the final state advertised, and kept on air last, after a latency bounded as for the workloads: each command
+    // ahead of it advertised in turn for its duration, at most one window per lamp before each turn. Ahead of it,
+    // the streamed frame already in the Advertiser and, when switched off, the commands of the last transition end.
+    CHECK(lamp.final_air_us > 0);
+    uint32_t window_ms = lamp.config.seq_duration + 3 * gap.latency_us_ / 1000;
+    uint32_t nb_state_cmds = lamp.controller->is_supported(Command(CommandType::LIGHT_WCOLOR)) ? 1 : 2;
+    uint32_t nb_turns = 1 + ((lamp.final_cmd.main_cmd_ == CommandType::LIGHT_OFF) ? nb_state_cmds + 1 : nb_state_cmds);
+    uint32_t max_latency_ms = nb_turns * (nb_lamps * window_ms + lamp.config.duration) + 2 * sim.loop_interval_us_ / 1000;
+    CHECK(final_ms <= max_latency_ms);
+    Command expected;
+    uint32_t id = 0;
+    if (!CHECK(on_air(lamp, lamp.final_cmd, expected, id))) continue;
+    CHECK((lamp.last_on_air.cmd_ == expected.cmd_) && std::equal(expected.args_, expected.args_ + 4, lamp.last_on_air.args_));
+    CHECK(lamp.controller->get_queue_depth() == 0);
+  }
+
+  CHECK(gap.get_nb_errors() == 0);
+  CHECK(handler->get_nb_dropped() == 0);
+  CHECK(!gap.is_advertising(0));
+  return host::test_result("lights");
+}
@@ -0,0 +1,71 @@
+// Advertiser queue cycles, as done by the handler: messages of 1 to 3 packets enqueued while there is room,
+// a round of advertising over the slots, the oldest message removed by id. No heap allocation once initialized.
+//   test_queue_alloc [nb_cycles]
+
+#include "harness/alloc_counter.h"
+#include "harness/test.h"
+
+#include "ble_adv_handler.h"
+
+#include <cstdlib>
+
+using namespace esphome::bleadvcontroller;
+
+int main(int argc, char ** argv) {
+  uint32_t nb_cycles = (argc > 1) ? atoi(argv[1]) : 10000;
+  static constexpr size_t CAPACITY = 16;
+  BleAdvQueue queue;
+  queue.init(CAPACITY);
+  std::vector< BleAdvParam > params;
+  params.reserve(3);
+  // msg ids in the queue, oldest first
+  uint16_t msg_ids[CAPACITY];
+  size_t nb_msgs = 0;
+  uint32_t nb_pushed = 0;
+  uint32_t nb_rotated = 0;
+  uint8_t buf[MAX_PACKET_LEN] = {0x02, 0x01, 0x19, 0x1B, 0x03};
+
+  uint32_t start_allocs = host::get_nb_allocs();
+  for (uint32_t cycle = 0; cycle < nb_cycles; ++cycle) {
+    params.resize(1 + cycle % 3);
+    for (auto & param : params) {
+      buf[5] = cycle & 0xFF;
+      param.from_raw(buf, sizeof(buf));
+    }
+    if (uint16_t msg_id = queue.push(params, cycle % 4, 0, cycle)) {
+      msg_ids[nb_msgs++] = msg_id;
+      nb_pushed++;
+    }
+    params.clear();
+
+    // a round: each slot advertised and rotated in turn, or dropped if removed before being advertised
+    for (size_t nb = queue.size(); nb > 0; --nb) {
+      uint8_t first = queue.first();
+      BleAdvProcess & slot = queue.at(first);
+      if (slot.to_be_removed_) {
+        queue.erase(first);
+      } else {
+        slot.processed_once_ = true;
+        queue.take(first);
+        nb_rotated++;
+      }
+    }
+
+    // keep a few messages in the queue
+    if (nb_msgs > 4) {
+      queue.remove(msg_ids[0]);
+      // removing again, or with the id of a reused slot, has no effect
+      queue.remove(msg_ids[0]);
+      for (size_t i = 1; i < nb_msgs; ++i) msg_ids[i - 1] = msg_ids[i];
+      nb_msgs--;
+    }
+  }
+  uint32_t nb_allocs = host::get_nb_allocs() - start_allocs;
+
+  printf("%d cycles: %d messages pushed, %d rotations, %d allocations\n", nb_cycles, nb_pushed, nb_rotated, nb_allocs);
+  CHECK(nb_allocs == 0);
+  CHECK(nb_pushed == nb_cycles);
+  CHECK(nb_rotated > 0);
+  CHECK(queue.size() <= CAPACITY);
+  return host::test_result("queue_alloc");
+}
@@ -0,0 +1,60 @@
+// No heap allocation in the encode path, for all command types and all encoders / variants, 'All' ones included:
+// is_supported(), translate() and encode() in params with room for the packets, as reserved by the controllers.
+//   test_translate_alloc [nb_loops]
+
+#include "harness/alloc_counter.h"
+#include "harness/encoders.h"
+#include "harness/test.h"
+
+#include <cstdlib>
+
+using namespace esphome::bleadvcontroller;
+
+int main(int argc, char ** argv) {
+  uint32_t nb_loops = (argc > 1) ? atoi(argv[1]) : 10;
+  esphome::host_log_level = ESPHOME_LOG_LEVEL_WARN;
+  BleAdvHandler handler;
+  host::register_encoders(handler);
+  srand(1);
+
+  std::vector< BleAdvParam > params;
+  params.reserve(16);
+  uint32_t nb_calls = 0;
+  for (uint8_t handle = 0; BleAdvEncoder * encoder = handler.get_encoder(handle); ++handle) {
+    uint32_t nb_allocs[3] = {0};
+    for (uint8_t type = 0; type < MAX_COMMAND_TYPE; ++type) {
+      for (uint32_t i = 0; i < nb_loops; ++i) {
+        Command cmd((CommandType)type);
+        for (auto & arg : cmd.args_) arg = rand() & 0xFF;
+        ControllerParam_t cont;
+        cont.id_ = rand() & 0xFFFF;
+        cont.index_ = rand() & 0xFF;
+        cont.tx_count_ = rand() & 0x7F;
+
+        uint32_t start = host::get_nb_allocs();
+        bool supported = encoder->is_supported(cmd);
+        nb_allocs[0] += host::get_nb_allocs() - start;
+        if (!supported) continue;
+
+        start = host::get_nb_allocs();
+        Commands cmds = encoder->translate(cmd, cont);
+        nb_allocs[1] += host::get_nb_allocs() - start;
+        // 'All' encoders only translate through their variants
+        CHECK((cmds.size() <= Commands::MAX_COMMANDS) && (!cmds.empty() || (encoder->get_data_len() == 0)));
+
+        params.clear();
+        start = host::get_nb_allocs();
+        encoder->encode(params, cmd, cont);
+        nb_allocs[2] += host::get_nb_allocs() - start;
+        CHECK(!params.empty() && (params.size() <= params.capacity()));
+        nb_calls++;
+      }
+    }
+    printf("%-20s is_supported %d, translate %d, encode %d allocations\n", encoder->get_id().c_str(),
+           nb_allocs[0], nb_allocs[1], nb_allocs[2]);
+    CHECK((nb_allocs[0] == 0) && (nb_allocs[1] == 0) && (nb_allocs[2] == 0));
+  }
+  printf("%d commands encoded\n", nb_calls);
+  CHECK(nb_calls > 0);
+  return host::test_result("translate_alloc");
+}
@@ -0,0 +1,46 @@
+// Whitening from the keystream tables against the bit by bit LFSR, for all seeds and lengths up to twice a packet,
+// on the precomputed keystreams of the encoder seeds and the generic path. Then time of both per packet.
+//   test_whitening [nb_loops]
+
+#include "harness/primitives.h"
+#include "harness/test.h"
+
+#include <cstdlib>
+#include <cstring>
+
+using host::Primitives;
+
+int main(int argc, char ** argv) {
+  uint32_t nb_loops = (argc > 1) ? atoi(argv[1]) : 100000;
+  Primitives prim;
+  srand(1);
+
+  static constexpr size_t MAX_LEN = 2 * esphome::bleadvcontroller::MAX_PACKET_LEN + 2;
+  uint32_t nb_checks = 0;
+  for (uint16_t seed = 0; seed < 256; ++seed) {
+    for (size_t len = 0; len <= MAX_LEN; ++len) {
+      uint8_t ref[MAX_LEN + 1];
+      for (auto & b : ref) b = rand() & 0xFF;
+      uint8_t buf[MAX_LEN + 1];
+      memcpy(buf, ref, sizeof(buf));
+      Primitives::ref_whiten(ref, len, seed);
+      prim.whiten(buf, len, seed);
+      // the byte after len untouched
+      if (!CHECK(memcmp(ref, buf, sizeof(buf)) == 0)) {
+        fprintf(stderr, "seed 0x%02X, len %d: whitening differs\n", seed, (int)len);
+      }
+      nb_checks++;
+    }
+  }
+  printf("%d seed x length checked\n", nb_checks);
+
+  // static for the timed loops not to be optimized out
+  static uint8_t buf[esphome::bleadvcontroller::MAX_PACKET_LEN] = {0};
+  const uint8_t seeds[] = {0x37, 0x12};
+  for (uint8_t seed : seeds) {
+    double ref_ns = host::time_ns(nb_loops, [&](uint32_t) { Primitives::ref_whiten(buf, sizeof(buf), seed); });
+    double table_ns = host::time_ns(nb_loops, [&](uint32_t) { prim.whiten(buf, sizeof(buf), seed); });
+    printf("seed 0x%02X, %d bytes: bit by bit %.1f ns, tables %.1f ns\n", seed, (int)sizeof(buf), ref_ns, table_ns);
+  }
+  return host::test_result("whitening");
+}
@@ -0,0 +1,351 @@
+// Scripted workload over the Advertiser, run in virtual time on a FakeGap:
+// several controllers receiving bursts of commands as from slider drags, at the same time.
+//   test_workload [round_robin|weighted_fair|priority] [nb_sets] [--busy nb_controllers] [--timeline]
+// Prints per controller the commands advertised, their latency, airtime share and max queue depth,
+// and with --timeline the packets on air. With --busy, nb_controllers all dragging a slider at the same time.
+//
+// The airtime share is the one of the whole run, a controller alone in the Advertiser keeping its last command
+// on air up to its max duration. The weights are checked on the airtime when contended instead: at each ms with
+// several controllers having a packet in the Advertiser, the one on air against its fair share w / sum(w).
+
+#include "harness/encoders.h"
+#include "harness/fake_gap.h"
+#include "harness/sim.h"
+#include "harness/test.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+using namespace esphome::bleadvcontroller;
+using host::Sim;
+
+struct Step {
+  uint32_t time_ms;
+  CommandType type;
+  uint8_t arg;
+  uint8_t arg2;
+};
+
+struct Workload {
+  host::ControllerConfig config;
+  std::vector< Step > steps;
+
+  BleAdvController * controller{nullptr};
+  BleAdvEncoder * encoder{nullptr};
+  uint32_t air_id{0};
+  size_t max_queue_depth{0};
+  uint64_t airtime_us{0};
+  uint32_t nb_air{0};
+  Command last_on_air;
+  // commands of the steps as decoded from the air
+  std::vector< Command > expected;
+  // first time on air of each step, or of a step superseding it
+  std::vector< uint64_t > on_air_us;
+  uint32_t max_latency_ms{0};
+  // airtime when contended, and fair share of it, in ms
+  double contended_ms{0};
+  double fair_ms{0};
+};
+
+// access to the packets in the Advertiser, to know the controllers contending for it
+struct WorkloadHandler: public BleAdvHandler {
+  using BleAdvHandler::packets_;
+  using BleAdvHandler::MAX_WAITS;
+};
+
+static bool is_continuous(CommandType type) {
+  return (type == CommandType::LIGHT_DIM) || (type == CommandType::LIGHT_CCT)
+      || (type == CommandType::LIGHT_WCOLOR) || (type == CommandType::FAN_SPEED);
+}
+
+static bool is_same(const Command & cmd, const Command & ref) {
+  return (cmd.cmd_ == ref.cmd_) && std::equal(ref.args_, ref.args_ + 4, cmd.args_);
+}
+
+// slider drag: a command every period_ms in [start_ms, start_ms + duration_ms)
+static void drag(std::vector< Step > & steps, CommandType type, uint32_t start_ms, uint32_t duration_ms, uint32_t period_ms) {
+  uint8_t arg = 0;
+  for (uint32_t t = start_ms; t < start_ms + duration_ms; t += period_ms) {
+    steps.push_back({t, type, arg, (uint8_t)(255 - arg)});
+    arg += 5;
+  }
+}
+
+// decoded command and controller id of a packet, false if not decoded by the encoder
+static bool decode(BleAdvEncoder * encoder, const uint8_t * buf, uint8_t len, Command & cmd, uint32_t & id) {
+  BleAdvParam param;
+  param.from_raw(buf, len);
+  ControllerParam_t cont;
+  cmd = Command(CommandType::CUSTOM);
+  if (!encoder->decode(param, cmd, cont)) return false;
+  id = cont.id_;
+  return true;
+}
+
+int main(int argc, char ** argv) {
+  SchedulerPolicy policy = SchedulerPolicy::ROUND_ROBIN;
+  uint8_t nb_sets = 1;
+  size_t nb_busy = 0;
+  bool timeline = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--timeline") == 0) timeline = true;
+    else if ((strcmp(argv[i], "--busy") == 0) && (i + 1 < argc)) nb_busy = atoi(argv[++i]);
+    else if (strcmp(argv[i], "weighted_fair") == 0) policy = SchedulerPolicy::WEIGHTED_FAIR;
+    else if (strcmp(argv[i], "priority") == 0) policy = SchedulerPolicy::PRIORITY;
+    else if (strcmp(argv[i], "round_robin") != 0) nb_sets = atoi(argv[i]);
+  }
+  srand(1);
+
+  std::vector< Workload > loads;
+  if (nb_busy > 0) {
+    // all the controllers switched on and dragging a slider, of the most common encodings
+    static const char * ENCODINGS[][2] = {{"zhijia", "v2"}, {"fanlamp_pro", "v3"}, {"lampsmart_pro", "v3"}};
+    static const char * NAMES[] = {"lamp0", "lamp1", "lamp2", "lamp3", "lamp4", "lamp5", "lamp6", "lamp7",
+                                   "lamp8", "lamp9", "lamp10", "lamp11", "lamp12", "lamp13", "lamp14", "lamp15"};
+    nb_busy = std::min(nb_busy, sizeof(NAMES) / sizeof(NAMES[0]));
+    loads.resize(nb_busy);
+    for (size_t i = 0; i < nb_busy; ++i) {
+      loads[i].config = {NAMES[i], ENCODINGS[i % 3][0], ENCODINGS[i % 3][1]};
+      loads[i].steps = {{(uint32_t)(10 * i), CommandType::LIGHT_ON}};
+      drag(loads[i].steps, (i % 3 == 0) ? CommandType::LIGHT_DIM : CommandType::LIGHT_WCOLOR, 200 + 10 * i, 2500, 50);
+    }
+  } else {
+    loads.resize(6);
+    loads[0].config = {"kitchen", "fanlamp_pro", "v3"};
+    loads[0].config.weight = 3;
+    loads[0].steps = {{0, CommandType::LIGHT_ON}};
+    drag(loads[0].steps, CommandType::LIGHT_WCOLOR, 100, 1000, 20);
+    loads[0].steps.push_back({3000, CommandType::LIGHT_OFF});
+
+    loads[1].config = {"living", "lampsmart_pro", "v3"};
+    loads[1].config.weight = 2;
+    loads[1].steps = {{10, CommandType::LIGHT_ON}};
+    drag(loads[1].steps, CommandType::LIGHT_WCOLOR, 200, 1000, 25);
+
+    loads[2].config = {"bedroom", "zhijia", "v2"};
+    loads[2].steps = {{20, CommandType::LIGHT_ON}};
+    drag(loads[2].steps, CommandType::LIGHT_DIM, 500, 1000, 30);
+
+    loads[3].config = {"ceiling_fan", "fanlamp_pro", "v1"};
+    loads[3].steps = {{400, CommandType::FAN_ONOFF_SPEED, 2, 6}, {800, CommandType::FAN_ONOFF_SPEED, 4, 6}, {1200, CommandType::FAN_ONOFF_SPEED, 6, 6}};
+
+    loads[4].config = {"hall", "zhijia", "v0"};
+    loads[4].steps = {{0, CommandType::LIGHT_ON}, {600, CommandType::LIGHT_OFF}, {1200, CommandType::LIGHT_ON}};
+
+    loads[5].config = {"desk", "other", "v1b"};
+    loads[5].steps = {{50, CommandType::PAIR}};
+  }
+
+  Sim & sim = Sim::get();
+  auto * handler = new WorkloadHandler();
+  host::FakeGap gap(nb_sets);
+  handler->set_gap(&gap);
+  handler->set_scheduler(policy);
+  host::register_encoders(*handler);
+  sim.add_component(handler);
+  for (auto & load : loads) {
+    load.controller = host::make_controller(*handler, load.config);
+    load.encoder = handler->get_encoder(load.config.encoding, load.config.variant);
+    sim.add_component(load.controller);
+  }
+  sim.setup();
+
+  // id of the controller as decoded from its packets, some encodings only keeping part of it
+  for (auto & load : loads) {
+    std::vector< BleAdvParam > params;
+    Command cmd(CommandType::LIGHT_ON);
+    ControllerParam_t cont;
+    cont.id_ = esphome::fnv1_hash(load.config.name);
+    load.encoder->encode(params, cmd, cont);
+    Command dec;
+    CHECK(!params.empty() && decode(load.encoder, params.back().get_full_buf(), params.back().get_full_len(), dec, load.air_id));
+
+    // the command of each step as decoded from the air
+    for (auto & step : load.steps) {
+      params.clear();
+      Command step_cmd(step.type);
+      step_cmd.args_[0] = step.arg;
+      step_cmd.args_[1] = step.arg2;
+      load.encoder->encode(params, step_cmd, cont);
+      load.expected.emplace_back();
+      uint32_t id = 0;
+      CHECK(!params.empty() && decode(load.encoder, params.back().get_full_buf(), params.back().get_full_len(), load.expected.back(), id));
+    }
+    load.on_air_us.resize(load.steps.size(), 0);
+  }
+  uint64_t start_us = sim.now_us();
+
+  // commands issued by the main loop, as from the entities
+  for (auto & load : loads) {
+    for (auto & step : load.steps) {
+      Workload * pload = &load;
+      sim.post_to_loop((uint64_t)step.time_ms * 1000, [pload, step]() {
+        Command cmd(step.type);
+        cmd.args_[0] = step.arg;
+        cmd.args_[1] = step.arg2;
+        CHECK(pload->controller->enqueue(cmd));
+      });
+    }
+  }
+  // queue depth sampled every ms, and with a single set the airtime when contended
+  size_t nb_airs = 0;
+  Workload * on_air = nullptr;
+  std::function< void() > sample = [&]() {
+    for (auto & load : loads) {
+      load.max_queue_depth = std::max(load.max_queue_depth, load.controller->get_queue_depth());
+    }
+    sim.after_us(1000, sample);
+    if (nb_sets != 1) return;
+    auto & airs = gap.get_airs();
+    if (airs.size() != nb_airs) {
+      nb_airs = airs.size();
+      on_air = nullptr;
+      for (auto & load : loads) {
+        Command cmd;
+        uint32_t id = 0;
+        if (decode(load.encoder, airs.back().buf_, airs.back().len_, cmd, id) && (id == load.air_id)) on_air = &load;
+      }
+    }
+    if ((on_air != nullptr) && !airs.back().is_on_air()) on_air = nullptr;
+    // controllers with a packet in the Advertiser not to be removed
+    std::vector< Workload * > busy;
+    uint32_t total_weight = 0;
+    uint8_t index = handler->packets_.first();
+    for (size_t i = 0; i < handler->packets_.size(); ++i) {
+      auto & slot = handler->packets_.at(index);
+      index = slot.next_;
+      if (slot.to_be_removed_) continue;
+      for (auto & load : loads) {
+        if ((load.controller->get_flow() == slot.flow_) && (std::find(busy.begin(), busy.end(), &load) == busy.end())) {
+          busy.push_back(&load);
+          total_weight += load.config.weight;
+        }
+      }
+    }
+    if (busy.size() < 2) return;
+    for (auto load : busy) {
+      load->fair_ms += (double)load->config.weight / total_weight;
+      load->contended_ms += (load == on_air) ? 1 : 0;
+    }
+  };
+  sim.after_us(0, sample);
+
+  // last command at 3 s, advertised at most max_duration, after a longer latency with many busy controllers
+  sim.run_for_ms((nb_busy > 0) ? 12000 : 8000);
+
+  // attribute the packets on air to the controllers, and to the steps they advertise first
+  uint64_t total_airtime_us = 0;
+  // for each packet on air, its controller and if it is a continuous command
+  std::vector< std::pair< Workload *, bool > > air_loads;
+  for (auto & air : gap.get_airs()) {
+    uint64_t airtime_us = (air.is_on_air() ? sim.now_us() : air.end_us_) - air.start_us_;
+    total_airtime_us += airtime_us;
+    air_loads.emplace_back(nullptr, false);
+    for (auto & load : loads) {
+      Command cmd;
+      uint32_t id = 0;
+      if (decode(load.encoder, air.buf_, air.len_, cmd, id) && (id == load.air_id)) {
+        load.airtime_us += airtime_us;
+        load.nb_air++;
+        load.last_on_air = cmd;
+        air_loads.back().first = &load;
+        for (size_t k = 0; k < load.steps.size(); ++k) {
+          if (!is_same(cmd, load.expected[k])) continue;
+          air_loads.back().second = is_continuous(load.steps[k].type);
+          // first air of the step, and of the previous ones not advertised, superseded by it
+          if ((load.on_air_us[k] == 0) && (start_us + (uint64_t)load.steps[k].time_ms * 1000 <= air.start_us_)) {
+            for (size_t j = k + 1; (j > 0) && (load.on_air_us[j - 1] == 0); --j) {
+              load.on_air_us[j - 1] = air.start_us_;
+              uint32_t latency_ms = (air.start_us_ - start_us) / 1000 - load.steps[j - 1].time_ms;
+              load.max_latency_ms = std::max(load.max_latency_ms, latency_ms);
+            }
+            break;
+          }
+        }
+        break;
+      }
+    }
+  }
+
+  if (timeline) {
+    host::print_timeline(stdout, *handler, gap);
+  }
+  printf("policy %d, %d sets: %d packets on air, %d GAP requests, %d main loop iterations\n",
+          policy, nb_sets, (int)gap.get_airs().size(), gap.get_nb_requests(), sim.get_nb_loops());
+  printf("%-12s %6s %8s %8s %8s %8s %8s %8s %9s %6s %9s\n", "controller", "weight", "requests", "on_air", "p50_ms", "p95_ms",
+         "max_ms", "airtime", "max_queue", "fair", "cmd_to_air");
+  double total_contended_ms = 0;
+  double total_fair_ms = 0;
+  uint32_t total_weight = 0;
+  for (auto & load : loads) {
+    total_weight += load.config.weight;
+    total_contended_ms += load.contended_ms;
+    total_fair_ms += load.fair_ms;
+  }
+  for (auto & load : loads) {
+    BleAdvHistogram * latency = handler->get_latency(load.controller->get_flow());
+    // share of the contended airtime over the fair share as per the weights, the switches taking some airtime
+    double fair = (load.fair_ms > 0) ? (load.contended_ms / total_contended_ms) / (load.fair_ms / total_fair_ms) : 0.0;
+    printf("%-12s %6d %8d %8d %8d %8d %8d %7.1f%% %9d %6.2f %9d\n", load.config.name, load.config.weight, (int)load.steps.size(), 
+            load.nb_air, latency->get_percentile(50), latency->get_percentile(95), latency->get_max(),
+            total_airtime_us ? 100.0 * load.airtime_us / total_airtime_us : 0.0, (int)load.max_queue_depth, fair, load.max_latency_ms);
+
+    // airtime shared as per the weights when contended, if long enough for the scheduling to settle
+    if ((policy == SchedulerPolicy::WEIGHTED_FAIR) && (nb_sets == 1) && (load.fair_ms > 1000)) {
+      CHECK((fair > 0.8) && (fair < 1.25));
+    }
+    // command to air latency bounded, whatever the number of busy controllers: the previous command of the controller 
+    // advertised once and kept its duration, then the next one advertised, each after at most sum(w) / w windows,
+    // or with priority after MAX_WAITS windows and the ones of the other packets passed over as many times.
+    uint32_t window_ms = load.config.seq_duration + 3 * gap.latency_us_ / 1000;
+    uint32_t max_windows = total_weight / load.config.weight;
+    if (policy == SchedulerPolicy::PRIORITY) max_windows = std::max(max_windows, WorkloadHandler::MAX_WAITS + (uint32_t)loads.size());
+    uint32_t max_latency_ms = 2 * max_windows * window_ms + load.config.duration + 2 * sim.loop_interval_us_ / 1000;
+    if ((policy != SchedulerPolicy::ROUND_ROBIN) || (nb_busy > 0)) {
+      CHECK(load.max_latency_ms <= max_latency_ms);
+    }
+
+    // the final state of each controller was advertised
+    CHECK(load.nb_air > 0);
+    std::vector< BleAdvParam > params;
+    Command final_cmd(load.steps.back().type);
+    final_cmd.args_[0] = load.steps.back().arg;
+    final_cmd.args_[1] = load.steps.back().arg2;
+    ControllerParam_t cont;
+    cont.id_ = esphome::fnv1_hash(load.config.name);
+    load.encoder->encode(params, final_cmd, cont);
+    Command expected;
+    uint32_t id = 0;
+    if (!CHECK(!params.empty())) continue;
+    CHECK(decode(load.encoder, params.back().get_full_buf(), params.back().get_full_len(), expected, id));
+    CHECK((load.last_on_air.cmd_ == expected.cmd_) && std::equal(expected.args_, expected.args_ + 4, load.last_on_air.args_));
+    CHECK(load.controller->get_queue_depth() == 0);
+  }
+
+  // with priority, ON / OFF commands advertised before the DIM ones waiting: once submitted (the previous command 
+  // of the controller advertised for its duration), the next packets on air are not continuous ones until it is on air.
+  // With several sets, the other sets keep advertising the continuous ones meanwhile.
+  for (auto & load : loads) {
+    if ((policy != SchedulerPolicy::PRIORITY) || (nb_sets != 1)) break;
+    for (size_t k = 1; k < load.steps.size(); ++k) {
+      if (is_continuous(load.steps[k].type) || (load.on_air_us[k] == 0)) continue;
+      uint64_t submit_us = std::max(start_us + (uint64_t)load.steps[k].time_ms * 1000, 
+                                    load.on_air_us[k - 1] + (uint64_t)load.config.duration * 1000);
+      submit_us += sim.loop_interval_us_ + 3 * gap.latency_us_;
+      auto & airs = gap.get_airs();
+      for (size_t i = 0; i < airs.size(); ++i) {
+        if ((airs[i].start_us_ >= submit_us) && (airs[i].start_us_ < load.on_air_us[k])) {
+          CHECK(!air_loads[i].second);
+        }
+      }
+    }
+  }
+
+  CHECK(gap.get_nb_errors() == 0);
+  CHECK(handler->get_nb_dropped() == 0);
+  for (uint8_t set = 0; set < nb_sets; ++set) {
+    CHECK(!gap.is_advertising(set));
+  }
+  return host::test_result("workload");
+}